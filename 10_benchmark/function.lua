@@ -0,0 +1,42 @@
+-- the functions of the other examples, in one script.
+
+-- 2_runluafunction
+function add(x, y)
+    return x - y
+end
+
+function multi(x, y, z)
+    return x + y, y + z, x + z
+end
+
+-- tutorial/6
+if functions == nil then functions = {}; end
+if functions.computation == nil then functions.computation = {}; end
+local package = functions.computation;
+function package.multi_compute(x, y, z)
+    return x + y, y + z, x + z
+end
+
+-- tutorial/3, compute is a C function
+function call_compute(n)
+    local x = 0;
+    for i = 1, n do
+        x = compute(i, x);
+    end
+    return x;
+end
+
+-- 4_/5_, without the prints
+function applyDamage(attacker, target)
+    local damage = attacker:getDamage();
+    target:dealtDamage(damage);
+end
+
+-- 5_, getDamage is found through CharacterMT.__index -> UnitMT
+function call_getDamage(object, n)
+    local total = 0;
+    for i = 1, n do
+        total = total + object:getDamage();
+    end
+    return total;
+end
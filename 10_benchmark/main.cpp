@@ -0,0 +1,413 @@
+#include <lua.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "binder.hpp"
+#include "luacall.hpp"
+#include "userdatacache.hpp"
+
+/**
+ * How long each way of crossing between C++ and lua used in the other examples takes.
+ *
+ * Every benchmark is run for a while first to warm up, then timed over many samples.
+ * Each sample runs enough operations to take about SAMPLE_MS, and the ns/op of the samples
+ * are reported as min, median, p90, p99 and mean. The results are also written as json
+ * (to the file given as the first argument) so they can be compared between runs.
+ */
+
+static const int SAMPLES = 50;
+static const double SAMPLE_MS = 5;
+static const double WARMUP_MS = 100;
+
+///////////// The classes of part 5 ////////////
+class Unit
+{
+public:
+    Unit(const int& d = 1, const int& h = 20)
+        : damage(d), health(h)
+    {
+    }
+    int damage;
+    int health;
+
+    void dealtDamage(const int& damage)
+    {
+        health -= damage;
+        health = health < 0 ? 0 : health;
+    }
+
+    int getDamage()
+    {
+        return damage;
+    }
+};
+
+class Character : public Unit
+{
+public:
+    Character(const std::string& n, const int& d = 1, const int& h = 20)
+        : Unit(d, h), name(n)
+    {
+    }
+    std::string name;
+};
+
+// a new userdata every time, like putUnit/putCharacter in the examples before userdatacache.
+// userdatacache::push is how they push the objects now.
+void putUnit(lua_State* L, Unit& unit, const char* metatable)
+{
+    Unit** userdata = static_cast<Unit**>(lua_newuserdata(L, sizeof(Unit*)));
+    *userdata = &unit;
+    luaL_setmetatable(L, metatable);
+}
+
+Unit* checkUnit(lua_State* L, int index)
+{
+    void* unit = luaL_testudata(L, index, "UnitMT");
+    if(!unit)
+    {
+        unit = luaL_checkudata(L, index, "CharacterMT");
+    }
+    return *static_cast<Unit**>(unit);
+}
+
+namespace binder
+{
+    template <>
+    struct Self<Unit>
+    {
+        // only used by BoundUnitMT
+        static Unit* get(lua_State* L, int index)
+        {
+            return *static_cast<Unit**>(luaL_checkudata(L, index, "BoundUnitMT"));
+        }
+    };
+}
+
+extern "C"
+{
+    static int compute(lua_State* L)
+    {
+        int x = luaL_checkint(L, 1);
+        int y = luaL_checkint(L, 2);
+        lua_pushnumber(L, x - y);
+        return 1;
+    }
+
+    static int function_unit_getDamage(lua_State* L)
+    {
+        lua_pushnumber(L, checkUnit(L, 1)->getDamage());
+        return 1;
+    }
+
+    static int function_unit_dealtDamage(lua_State* L)
+    {
+        Unit* unit = checkUnit(L, 1);
+        unit->dealtDamage(luaL_checkint(L, 2));
+        return 0;
+    }
+}
+
+/**
+ * UnitMT with the hand written wrappers, CharacterMT inheriting from it,
+ * and BoundUnitMT with the wrappers generated by the binder.
+ */
+void loadWrappers(lua_State* L)
+{
+    luaL_newmetatable(L, "UnitMT");
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, function_unit_getDamage);
+    lua_setfield(L, -2, "getDamage");
+    lua_pushcfunction(L, function_unit_dealtDamage);
+    lua_setfield(L, -2, "dealtDamage");
+    lua_pop(L, 1);
+
+    luaL_newmetatable(L, "CharacterMT");
+    luaL_getmetatable(L, "UnitMT");
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
+    luaL_newmetatable(L, "BoundUnitMT");
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    const luaL_Reg methods[] = {
+        LUA_BIND("getDamage", &Unit::getDamage),
+        LUA_BIND("dealtDamage", &Unit::dealtDamage),
+        { 0, 0 }
+    };
+    luaL_setfuncs(L, methods, 0);
+    lua_pop(L, 1);
+}
+
+struct Result
+{
+    std::string name;
+    long long opsPerSample;
+    double min;
+    double median;
+    double p90;
+    double p99;
+    double mean;
+};
+
+/**
+ * run(n) must do n operations.
+ */
+Result measure(const std::string& name, const std::function<void(long long)>& run)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // find how many operations make a sample, and warm up while doing it.
+    long long ops = 1;
+    double elapsed = 0;
+    auto warmupStart = Clock::now();
+    while(true)
+    {
+        auto start = Clock::now();
+        run(ops);
+        elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if(elapsed >= SAMPLE_MS)
+        {
+            if(std::chrono::duration<double, std::milli>(Clock::now() - warmupStart).count() >= WARMUP_MS)
+            {
+                break;
+            }
+        }
+        else
+        {
+            ops *= 2;
+        }
+    }
+
+    std::vector<double> samples;
+    for(int i = 0; i < SAMPLES; i++)
+    {
+        auto start = Clock::now();
+        run(ops);
+        samples.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / ops);
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for(auto s : samples)
+    {
+        sum += s;
+    }
+    Result result;
+    result.name = name;
+    result.opsPerSample = ops;
+    result.min = samples.front();
+    result.median = samples[samples.size() / 2];
+    result.p90 = samples[(samples.size() * 90) / 100];
+    result.p99 = samples[(samples.size() * 99) / 100];
+    result.mean = sum / samples.size();
+    return result;
+}
+
+bool writeJson(const std::string& filename, const std::vector<Result>& results)
+{
+    FILE* file = fopen(filename.c_str(), "w");
+    if(!file)
+    {
+        return false;
+    }
+    fprintf(file, "{\n  \"unit\": \"ns/op\",\n  \"samples\": %d,\n  \"results\": [\n", SAMPLES);
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const Result& r = results[i];
+        fprintf(file, "    { \"name\": \"%s\", \"ops_per_sample\": %lld, \"min\": %.2f, \"median\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"mean\": %.2f }%s\n",
+                r.name.c_str(), r.opsPerSample, r.min, r.median, r.p90, r.p99, r.mean, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    lua_State* L = luaL_newstate();
+    luaL_requiref(L, "base", luaopen_base, 1);
+    lua_settop(L, 0);
+    lua_pushcfunction(L, compute);
+    lua_setglobal(L, "compute");
+    loadWrappers(L);
+    if(luaL_dofile(L, "function.lua") != LUA_OK)
+    {
+        std::cout << "[C++] error loading script" << std::endl;
+        return 1;
+    }
+
+    Unit attacker(0, 1000000);
+    Unit defender(0, 1000000);
+    Character character("Attacker", 3, 10);
+    std::vector<Result> results;
+
+    // 2_runluafunction : lookup "add" and call it, one return value.
+    results.push_back(measure("add (1 return)", [&](long long n)
+    {
+        for(long long i = 0; i < n; i++)
+        {
+            lua_getglobal(L, "add");
+            lua_pushnumber(L, 3);
+            lua_pushnumber(L, 4);
+            lua_call(L, 2, 1);
+            lua_tointeger(L, -1);
+            lua_pop(L, 1);
+        }
+    }));
+
+    // 2_runluafunction : 3 return values.
+    results.push_back(measure("multi (3 returns)", [&](long long n)
+    {
+        for(long long i = 0; i < n; i++)
+        {
+            lua_getglobal(L, "multi");
+            lua_pushnumber(L, 1);
+            lua_pushnumber(L, 3);
+            lua_pushnumber(L, 5);
+            lua_call(L, 3, 3);
+            lua_pop(L, 3);
+        }
+    }));
+
+    // 2_runluafunction : the same with luacall and a FunctionHandle, straight into a tuple.
+    {
+        // the handle must be gone before lua_close
+        FunctionHandle multiFunction(L, "multi");
+        results.push_back(measure("multi (luacall tuple)", [&](long long n)
+        {
+            std::tuple<int, int, int> sums;
+            for(long long i = 0; i < n; i++)
+            {
+                luacall::call(multiFunction, sums, 1, 3, 5);
+            }
+        }));
+    }
+
+    // tutorial/6 : functions.computation.multi_compute
+    results.push_back(measure("nested multi_compute", [&](long long n)
+    {
+        for(long long i = 0; i < n; i++)
+        {
+            lua_getglobal(L, "functions");
+            lua_getfield(L, -1, "computation");
+            lua_remove(L, -2);
+            lua_getfield(L, -1, "multi_compute");
+            lua_remove(L, -2);
+            lua_pushnumber(L, 1);
+            lua_pushnumber(L, 3);
+            lua_pushnumber(L, 5);
+            lua_call(L, 3, 3);
+            lua_pop(L, 3);
+        }
+    }));
+
+    // the same path resolved once by a FunctionHandle.
+    {
+        FunctionHandle multiCompute(L, "functions.computation.multi_compute");
+        results.push_back(measure("nested multi_compute (handle)", [&](long long n)
+        {
+            for(long long i = 0; i < n; i++)
+            {
+                multiCompute.push();
+                lua_pushnumber(L, 1);
+                lua_pushnumber(L, 3);
+                lua_pushnumber(L, 5);
+                lua_call(L, 3, 3);
+                lua_pop(L, 3);
+            }
+        }));
+    }
+
+    // tutorial/3 : the C function compute called from a lua loop.
+    results.push_back(measure("compute (C from lua)", [&](long long n)
+    {
+        lua_getglobal(L, "call_compute");
+        lua_pushinteger(L, (lua_Integer) n);
+        lua_call(L, 1, 1);
+        lua_pop(L, 1);
+    }));
+
+    // 4_/5_ : push 2 new userdata and call applyDamage, which calls 2 methods.
+    results.push_back(measure("applyDamage (userdata push + methods)", [&](long long n)
+    {
+        for(long long i = 0; i < n; i++)
+        {
+            lua_getglobal(L, "applyDamage");
+            putUnit(L, attacker, "UnitMT");
+            putUnit(L, defender, "UnitMT");
+            lua_call(L, 2, 0);
+        }
+    }));
+
+    // 4_/5_ as they are now : the same userdata for the same object, found in the cache.
+    results.push_back(measure("applyDamage (cached userdata + methods)", [&](long long n)
+    {
+        for(long long i = 0; i < n; i++)
+        {
+            lua_getglobal(L, "applyDamage");
+            userdatacache::push(L, &attacker, "UnitMT");
+            userdatacache::push(L, &defender, "UnitMT");
+            lua_call(L, 2, 0);
+        }
+    }));
+
+    // method found directly in UnitMT, as a baseline for the next one.
+    putUnit(L, attacker, "UnitMT");
+    int unitIndex = lua_gettop(L);
+    results.push_back(measure("getDamage on Unit", [&](long long n)
+    {
+        lua_getglobal(L, "call_getDamage");
+        lua_pushvalue(L, unitIndex);
+        lua_pushinteger(L, (lua_Integer) n);
+        lua_call(L, 2, 1);
+        lua_pop(L, 1);
+    }));
+
+    // 5_ : CharacterMT.__index -> UnitMT
+    putUnit(L, character, "CharacterMT");
+    int characterIndex = lua_gettop(L);
+    results.push_back(measure("getDamage on Character (inherited)", [&](long long n)
+    {
+        lua_getglobal(L, "call_getDamage");
+        lua_pushvalue(L, characterIndex);
+        lua_pushinteger(L, (lua_Integer) n);
+        lua_call(L, 2, 1);
+        lua_pop(L, 1);
+    }));
+
+    // 4_ : the wrapper generated by LUA_BIND instead of the hand written one.
+    putUnit(L, attacker, "BoundUnitMT");
+    int boundIndex = lua_gettop(L);
+    results.push_back(measure("getDamage on Unit (LUA_BIND)", [&](long long n)
+    {
+        lua_getglobal(L, "call_getDamage");
+        lua_pushvalue(L, boundIndex);
+        lua_pushinteger(L, (lua_Integer) n);
+        lua_call(L, 2, 1);
+        lua_pop(L, 1);
+    }));
+    lua_settop(L, 0);
+
+    printf("%-40s %10s %10s %10s %10s %10s\n", "ns/op", "min", "median", "p90", "p99", "mean");
+    for(auto& r : results)
+    {
+        printf("%-40s %10.2f %10.2f %10.2f %10.2f %10.2f\n", r.name.c_str(), r.min, r.median, r.p90, r.p99, r.mean);
+    }
+    if(argc > 1)
+    {
+        if(!writeJson(argv[1], results))
+        {
+            std::cout << "[C++] could not write " << argv[1] << std::endl;
+        }
+    }
+
+    lua_close(L);
+    return 0;
+}
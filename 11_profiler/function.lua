@@ -0,0 +1,22 @@
+-- the functions of part 5, with a bit more work in them so there is something to see in the profile.
+
+local function armour(target, damage)
+    local reduced = damage;
+    for i = 1, 20 do
+        reduced = reduced * 0.99;
+    end
+    return math.floor(reduced);
+end
+
+function applyDamage(attacker, target)
+    local damage = attacker:getDamage();
+    damage = armour(target, damage);
+    target:dealtDamage(damage);
+end
+
+function testcharacter(character)
+    local health = character:health();
+    for i = 1, 10 do
+        health = character:health(health + 1);
+    end
+end
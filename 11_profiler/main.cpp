@@ -0,0 +1,182 @@
+#include <lua.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "profiler.hpp"
+
+/**
+ * Profile the applyDamage and testcharacter scripts of part 5 while they run.
+ *
+ * usage : ./run [period] [calls]
+ * Samples every `period` instructions (default 1000), and also one in `period` calls to the C wrappers
+ * when "calls" is given. The result is written to profile.folded, see "make flamegraph.svg".
+ */
+
+class Unit 
+{
+public:
+    Unit(const int& d = 1, const int& h = 20)
+        : damage(d), health(h)
+    {
+    }
+    int damage;
+    int health;
+
+    void dealtDamage(const int& damage)
+    {
+        health -= damage;
+        health = health < 0 ? 0 : health;
+    }
+
+    int getDamage() 
+    {
+        return damage;
+    }
+};
+
+class Character : public Unit
+{
+public:
+    Character(const std::string& n, const int& d = 1, const int& h = 20)
+        : Unit(d, h), name(n)
+    {
+    }
+    std::string name;
+};
+
+void putCharacter(lua_State* L, Character& character)
+{
+    Character** userdata = static_cast<Character**>(lua_newuserdata(L, sizeof(Character*)));
+    *userdata = &character;
+    luaL_setmetatable(L, "CharacterMT");
+}
+
+void putUnit(lua_State* L, Unit& unit)
+{
+    Unit** userdata = static_cast<Unit**>(lua_newuserdata(L, sizeof(Unit*)));
+    *userdata = &unit;
+    luaL_setmetatable(L, "UnitMT");
+}
+
+Unit* toUnit(lua_State* L, int index)
+{
+    void* unit = luaL_testudata(L, index, "UnitMT");
+    if(!unit)
+    {
+        unit = luaL_checkudata(L, index, "CharacterMT");
+    }
+    return *static_cast<Unit**>(unit);
+}
+
+extern "C" 
+{
+    static int function_unit_getDamage(lua_State* L)
+    {
+        lua_pushnumber(L, toUnit(L, 1)->getDamage());
+        return 1;
+    }
+
+    static int function_unit_dealtDamage(lua_State* L)
+    {
+        Unit* unit = toUnit(L, 1);
+        unit->dealtDamage(luaL_checkint(L, 2));
+        return 0;
+    }
+
+    static int function_unit_health(lua_State* L)
+    {
+        Unit* unit = toUnit(L, 1);
+        if(lua_gettop(L) > 1)
+        {
+            unit->health = luaL_checkint(L, 2);
+        }
+        lua_pushnumber(L, unit->health);
+        return 1;
+    }
+}
+
+void loadWrapper(lua_State* L)
+{
+    luaL_newmetatable(L, "UnitMT");
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, function_unit_getDamage);
+    lua_setfield(L, -2, "getDamage");
+    lua_pushcfunction(L, function_unit_dealtDamage);
+    lua_setfield(L, -2, "dealtDamage");
+    lua_pushcfunction(L, function_unit_health);
+    lua_setfield(L, -2, "health");
+    lua_pop(L, 1);
+
+    luaL_newmetatable(L, "CharacterMT");
+    luaL_getmetatable(L, "UnitMT");
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+}
+
+double runTicks(lua_State* L, int ticks)
+{
+    Character attacker("Attacker", 3, 10);
+    Unit defender(1, 1000000);
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < ticks; i++)
+    {
+        lua_getglobal(L, "applyDamage");
+        putCharacter(L, attacker);
+        putUnit(L, defender);
+        lua_call(L, 2, 0);
+
+        lua_getglobal(L, "testcharacter");
+        putCharacter(L, attacker);
+        lua_call(L, 1, 0);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    int period = argc > 1 ? atoi(argv[1]) : 1000;
+    bool sampleCalls = argc > 2 && std::string(argv[2]) == "calls";
+    const int ticks = 200000;
+
+    lua_State* L = luaL_newstate();
+    std::vector<luaL_Reg> lualibs =
+        { {"base", luaopen_base} ,
+          {"math", luaopen_math} };
+    for(auto& it : lualibs)
+    {
+        luaL_requiref(L, it.name, it.func, 1);
+        lua_settop(L, 0);
+    }
+    loadWrapper(L);
+    if(luaL_dofile(L, "function.lua") != LUA_OK)
+    {
+        std::cout << "[C++] error loading script" << std::endl;
+        return 1;
+    }
+
+    double without = runTicks(L, ticks);
+
+    Profiler profiler;
+    profiler.nameCFunction(function_unit_getDamage, "function_unit_getDamage");
+    profiler.nameCFunction(function_unit_dealtDamage, "function_unit_dealtDamage");
+    profiler.nameCFunction(function_unit_health, "function_unit_health");
+    profiler.start(L, period, sampleCalls);
+    double with = runTicks(L, ticks);
+    profiler.stop();
+
+    std::cout << "[C++] without profiler : " << without << " ms" << std::endl;
+    std::cout << "[C++] with profiler    : " << with << " ms (" << profiler.sampleCount() << " samples, overhead "
+              << ((with - without) * 100 / without) << "%)" << std::endl;
+    if(profiler.writeFolded("profile.folded"))
+    {
+        std::cout << "[C++] written profile.folded" << std::endl;
+    }
+
+    lua_close(L);
+    return 0;
+}
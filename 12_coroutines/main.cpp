@@ -0,0 +1,154 @@
+#include <lua.hpp>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "scheduler.hpp"
+
+/**
+ * Scripts that take more than one frame.
+ *
+ * The functions in tasks.lua are run as tasks by the Scheduler. Each call to scheduler.wait
+ * gives control back to C++, and the frame loop calls tick() to let them continue.
+ * The second part starts many tasks at once, to see what a tick costs.
+ */
+
+class Unit
+{
+public:
+    Unit(const int& d = 1, const int& h = 20)
+        : damage(d), health(h)
+    {
+    }
+    int damage;
+    int health;
+
+    void dealtDamage(const int& damage)
+    {
+        health -= damage;
+        health = health < 0 ? 0 : health;
+    }
+
+    int getDamage()
+    {
+        return damage;
+    }
+};
+
+void putUnit(lua_State* L, Unit& unit)
+{
+    Unit** userdata = static_cast<Unit**>(lua_newuserdata(L, sizeof(Unit*)));
+    *userdata = &unit;
+    luaL_setmetatable(L, "UnitMT");
+}
+
+extern "C"
+{
+    static int function_unit_getDamage(lua_State* L)
+    {
+        Unit* unit = *static_cast<Unit**>(luaL_checkudata(L, 1, "UnitMT"));
+        lua_pushnumber(L, unit->getDamage());
+        return 1;
+    }
+
+    static int function_unit_dealtDamage(lua_State* L)
+    {
+        Unit* unit = *static_cast<Unit**>(luaL_checkudata(L, 1, "UnitMT"));
+        unit->dealtDamage(luaL_checkint(L, 2));
+        return 0;
+    }
+
+    static int function_unit_health(lua_State* L)
+    {
+        Unit* unit = *static_cast<Unit**>(luaL_checkudata(L, 1, "UnitMT"));
+        lua_pushnumber(L, unit->health);
+        return 1;
+    }
+}
+
+void loadWrapper(lua_State* L)
+{
+    luaL_newmetatable(L, "UnitMT");
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, function_unit_getDamage);
+    lua_setfield(L, -2, "getDamage");
+    lua_pushcfunction(L, function_unit_dealtDamage);
+    lua_setfield(L, -2, "dealtDamage");
+    lua_pushcfunction(L, function_unit_health);
+    lua_setfield(L, -2, "health");
+    lua_pop(L, 1);
+}
+
+void doThings(lua_State* L, Scheduler& scheduler)
+{
+    Unit spider(2, 10);
+    Unit hero(1, 50);
+
+    lua_getglobal(L, "poison");
+    putUnit(L, spider);
+    putUnit(L, hero);
+    lua_pushinteger(L, 3);
+    scheduler.spawn(3);
+
+    lua_getglobal(L, "ambush");
+    putUnit(L, spider);
+    putUnit(L, hero);
+    scheduler.spawn(2);
+
+    // the frame loop, the scripts run a bit every frame
+    for(int frame = 0; frame < 12; frame++)
+    {
+        if(frame == 5)
+        {
+            std::cout << "[C++] night falls" << std::endl;
+            scheduler.signal("night");
+        }
+        int resumed = scheduler.tick();
+        std::cout << "[C++] frame " << frame << " : resumed " << resumed << " tasks, hero health " << hero.health << std::endl;
+    }
+}
+
+void manyTasks(lua_State* L, Scheduler& scheduler, int count)
+{
+    typedef std::chrono::steady_clock Clock;
+    for(int i = 0; i < count; i++)
+    {
+        lua_getglobal(L, "wander");
+        lua_pushinteger(L, 10 + i % 20);
+        scheduler.spawn(1);
+    }
+
+    auto start = Clock::now();
+    long long resumed = 0;
+    int ticks = 0;
+    while(scheduler.taskCount() > 0)
+    {
+        resumed += scheduler.tick();
+        ticks++;
+    }
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::cout << "[C++] " << count << " tasks : " << ticks << " ticks, " << resumed << " resumes, "
+        << ms / ticks << " ms/tick, " << ms * 1000000 / resumed << " ns/resume, "
+        << scheduler.threadCount() << " threads made" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+    loadWrapper(L);
+    if(luaL_dofile(L, "tasks.lua") != LUA_OK)
+    {
+        std::cout << "[C++] error loading script : " << lua_tostring(L, -1) << std::endl;
+        return 1;
+    }
+    {
+        Scheduler scheduler(L);
+        doThings(L, scheduler);
+        // the threads of the first run are reused by the second.
+        manyTasks(L, scheduler, 10000);
+        manyTasks(L, scheduler, 10000);
+    }
+    lua_close(L);
+    return 0;
+}
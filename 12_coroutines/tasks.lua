@@ -0,0 +1,27 @@
+-- applyDamage of part 5, but spread over a few ticks instead of all at once.
+function poison(attacker, target, times)
+    for i = 1, times do
+        target:dealtDamage(attacker:getDamage());
+        print("[LUA] poison tick " .. i .. ", health " .. target:health());
+        scheduler.wait(2);
+    end
+end
+
+-- waits for the night before doing anything.
+function ambush(attacker, target)
+    print("[LUA] waiting for the night");
+    scheduler.waitEvent("night");
+    print("[LUA] ambush!");
+    target:dealtDamage(attacker:getDamage() * 3);
+    -- and keep poisoning it afterwards
+    scheduler.spawn(poison, attacker, target, 2);
+end
+
+-- a small task, many of them are started to see how the scheduler scales.
+function wander(ticks)
+    local steps = 0;
+    while steps < ticks do
+        steps = steps + 1;
+        scheduler.wait(1 + steps % 3);
+    end
+end
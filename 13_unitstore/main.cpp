@@ -0,0 +1,215 @@
+#include <lua.hpp>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "damagekernel.hpp"
+#include "unitstore.hpp"
+
+/**
+ * A script sweeping over many units, with the units as separate objects (like part 5)
+ * and with the units in a UnitStore.
+ *
+ * Every version makes each unit hit the next one, and they must end with the same total health.
+ * Then the paths of the damagekernel are checked against the plain loop and timed.
+ */
+
+static const int UNITS = 100000;
+
+class Unit
+{
+public:
+    Unit(const int& d = 1, const int& h = 20)
+        : damage(d), health(h)
+    {
+    }
+    int damage;
+    int health;
+
+    void dealtDamage(const int& damage)
+    {
+        health -= damage;
+        health = health < 0 ? 0 : health;
+    }
+
+    int getDamage()
+    {
+        return damage;
+    }
+};
+
+void putUnit(lua_State* L, Unit& unit)
+{
+    Unit** userdata = static_cast<Unit**>(lua_newuserdata(L, sizeof(Unit*)));
+    *userdata = &unit;
+    luaL_setmetatable(L, "UnitMT");
+}
+
+extern "C"
+{
+    static int function_unit_getDamage(lua_State* L)
+    {
+        Unit* unit = *static_cast<Unit**>(luaL_checkudata(L, 1, "UnitMT"));
+        lua_pushnumber(L, unit->getDamage());
+        return 1;
+    }
+
+    static int function_unit_dealtDamage(lua_State* L)
+    {
+        Unit* unit = *static_cast<Unit**>(luaL_checkudata(L, 1, "UnitMT"));
+        unit->dealtDamage(luaL_checkint(L, 2));
+        return 0;
+    }
+}
+
+void loadWrapper(lua_State* L)
+{
+    luaL_newmetatable(L, "UnitMT");
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, function_unit_getDamage);
+    lua_setfield(L, -2, "getDamage");
+    lua_pushcfunction(L, function_unit_dealtDamage);
+    lua_setfield(L, -2, "dealtDamage");
+    lua_pop(L, 1);
+}
+
+/**
+ * Call the sweep function with the value on top of the stack, and time it.
+ */
+void timeSweep(lua_State* L, const char* function)
+{
+    typedef std::chrono::steady_clock Clock;
+    int units = lua_gettop(L);
+    lua_getglobal(L, function);
+    lua_pushvalue(L, units);
+    auto start = Clock::now();
+    lua_call(L, 1, 0);
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::cout << "[C++] " << function << " : " << ms << " ms" << std::endl;
+}
+
+void doThings(lua_State* L)
+{
+    // the units as objects, lua gets a table of userdata pointing to them.
+    std::vector<Unit> objects;
+    for(int i = 0; i < UNITS; i++)
+    {
+        objects.push_back(Unit(1 + i % 7, 20 + i % 13));
+    }
+    lua_createtable(L, UNITS, 0);
+    for(int i = 0; i < UNITS; i++)
+    {
+        putUnit(L, objects[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    timeSweep(L, "sweep_objects");
+    lua_pop(L, 1);
+    long long objectsTotal = 0;
+    for(auto& unit : objects)
+    {
+        objectsTotal += unit.health;
+    }
+
+    // the same units in stores, one for each of the other versions.
+    UnitStore columns;
+    UnitStore bulk;
+    for(int i = 0; i < UNITS; i++)
+    {
+        columns.add(1 + i % 7, 20 + i % 13);
+        bulk.add(1 + i % 7, 20 + i % 13);
+    }
+    columns.push(L);
+    timeSweep(L, "sweep_columns");
+    lua_pop(L, 1);
+
+    bulk.push(L);
+    timeSweep(L, "sweep_bulk");
+    lua_getglobal(L, "total_health");
+    lua_pushvalue(L, -2);
+    lua_call(L, 1, 1);
+    long long bulkTotal = (long long) lua_tonumber(L, -1);
+    lua_pop(L, 2);
+
+    long long columnsTotal = 0;
+    for(auto health : columns.health)
+    {
+        columnsTotal += health;
+    }
+    std::cout << "[C++] total health : objects " << objectsTotal << ", columns " << columnsTotal << ", bulk " << bulkTotal << std::endl;
+}
+
+/**
+ * Every path of the kernel must give the same health as the scalar one, byte for byte.
+ */
+void kernels(lua_State* L)
+{
+    typedef std::chrono::steady_clock Clock;
+    std::vector<int> start(UNITS + 3);
+    std::vector<int> damages(start.size());
+    unsigned seed = 1;
+    for(size_t i = 0; i < start.size(); i++)
+    {
+        // negative health and damage too, the clamp has to agree there as well.
+        seed = seed * 1103515245 + 12345;
+        start[i] = (int) (seed >> 16) % 200 - 20;
+        seed = seed * 1103515245 + 12345;
+        damages[i] = (int) (seed >> 16) % 50 - 5;
+    }
+
+    std::vector<int> expected = start;
+    damagekernel::dealtDamage(expected.data(), (int) expected.size(), damages.data(), damagekernel::SCALAR);
+    damagekernel::dealtDamage(expected.data(), (int) expected.size(), 7, damagekernel::SCALAR);
+
+    const damagekernel::Path paths[] = { damagekernel::SCALAR, damagekernel::SSE2, damagekernel::AVX2 };
+    for(auto path : paths)
+    {
+        if(!damagekernel::isSupported(path))
+        {
+            std::cout << "[C++] " << damagekernel::pathName(path) << " : not supported" << std::endl;
+            continue;
+        }
+        std::vector<int> health = start;
+        damagekernel::dealtDamage(health.data(), (int) health.size(), damages.data(), path);
+        damagekernel::dealtDamage(health.data(), (int) health.size(), 7, path);
+        bool same = memcmp(health.data(), expected.data(), health.size() * sizeof(int)) == 0;
+
+        const int repeat = 1000;
+        auto begin = Clock::now();
+        for(int i = 0; i < repeat; i++)
+        {
+            health = start;
+            damagekernel::dealtDamage(health.data(), (int) health.size(), 1, path);
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / repeat / health.size();
+        std::cout << "[C++] " << damagekernel::pathName(path) << " : " << (same ? "same" : "DIFFERENT") << ", " << ns << " ns/unit (with the copy)" << std::endl;
+    }
+    std::cout << "[C++] best path : " << damagekernel::pathName(damagekernel::best()) << std::endl;
+
+    // area of effect from lua, in one call
+    UnitStore store;
+    for(int i = 0; i < UNITS; i++)
+    {
+        store.add(1 + i % 7, 20 + i % 13);
+    }
+    store.push(L);
+    timeSweep(L, "area_damage");
+    lua_pop(L, 1);
+}
+
+int main(int argc, char* argv[])
+{
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+    loadWrapper(L);
+    if(luaL_dofile(L, "sweep.lua") != LUA_OK)
+    {
+        std::cout << "[C++] error loading script : " << lua_tostring(L, -1) << std::endl;
+        return 1;
+    }
+    doThings(L);
+    kernels(L);
+    lua_close(L);
+    return 0;
+}
@@ -0,0 +1,44 @@
+-- every unit hits the next one, the way it is done with one userdata per unit.
+function sweep_objects(units)
+    for i = 1, #units - 1 do
+        units[i + 1]:dealtDamage(units[i]:getDamage());
+    end
+end
+
+-- the same with the columns of the store.
+function sweep_columns(units)
+    local health = units.health;
+    local damage = units.damage;
+    for i = 1, #health - 1 do
+        local h = health[i + 1] - damage[i];
+        if h < 0 then
+            h = 0;
+        end
+        health[i + 1] = h;
+    end
+end
+
+-- the same with one bulk call.
+function sweep_bulk(units)
+    units:attack(1, #units - 1, 2);
+end
+
+function total_health(units)
+    local health = units.health;
+    local total = 0;
+    for i = 1, #health do
+        total = total + health[i];
+    end
+    return total;
+end
+
+-- the first half takes 5 damage, and the second half more the further it is.
+function area_damage(units)
+    local half = math.floor(#units / 2);
+    units:dealtDamage(1, half, 5);
+    local damages = {};
+    for i = half + 1, #units do
+        damages[#damages + 1] = (i - half) % 10;
+    end
+    units:dealtDamage(half + 1, #units, damages);
+end
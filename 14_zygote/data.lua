@@ -0,0 +1,22 @@
+-- the kind of data a game loads at startup, big enough to take a while and some memory.
+monsters = {};
+for i = 1, 200000 do
+    monsters[i] = {
+        name = "monster" .. i,
+        kind = (i % 3 == 0) and "bear" or "snake",
+        strength = i % 50,
+    };
+end
+
+function total_damage(first, last)
+    local total = 0;
+    for i = first, last do
+        local monster = monsters[i];
+        if monster.kind == "bear" then
+            total = total + bear_damage_func(monster.strength);
+        else
+            total = total + snake_damage_func(monster.strength);
+        end
+    end
+    return total;
+end
@@ -0,0 +1,288 @@
+#include <lua.hpp>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "functionhandle.hpp"
+#include "zygote.hpp"
+
+/**
+ * Starting workers by loading everything in each of them, and by forking them from a zygote.
+ *
+ * The state has the libraries, the metatables of part 5 and two scripts, one of them building
+ * a big table. The workers each add up the damage of a part of the monsters, and while they are
+ * all alive the memory they share with each other is read from /proc.
+ */
+
+static const int WORKERS = 4;
+static const int MONSTERS = 200000;
+typedef std::chrono::steady_clock Clock;
+
+class Unit
+{
+public:
+    Unit(const int& d = 1, const int& h = 20)
+        : damage(d), health(h)
+    {
+    }
+    int damage;
+    int health;
+
+    void dealtDamage(const int& damage)
+    {
+        health -= damage;
+        health = health < 0 ? 0 : health;
+    }
+
+    int getDamage()
+    {
+        return damage;
+    }
+};
+
+Unit* toUnit(lua_State* L, int index)
+{
+    void* unit = luaL_testudata(L, index, "UnitMT");
+    if(!unit)
+    {
+        unit = luaL_checkudata(L, index, "CharacterMT");
+    }
+    return *static_cast<Unit**>(unit);
+}
+
+extern "C"
+{
+    static int function_unit_getDamage(lua_State* L)
+    {
+        lua_pushnumber(L, toUnit(L, 1)->getDamage());
+        return 1;
+    }
+
+    static int function_unit_dealtDamage(lua_State* L)
+    {
+        toUnit(L, 1)->dealtDamage(luaL_checkint(L, 2));
+        return 0;
+    }
+}
+
+/**
+ * Everything a worker needs before it can do anything, the part a zygote does only once.
+ */
+bool initState(lua_State* L)
+{
+    luaL_openlibs(L);
+
+    luaL_newmetatable(L, "UnitMT");
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, function_unit_getDamage);
+    lua_setfield(L, -2, "getDamage");
+    lua_pushcfunction(L, function_unit_dealtDamage);
+    lua_setfield(L, -2, "dealtDamage");
+    lua_pop(L, 1);
+
+    luaL_newmetatable(L, "CharacterMT");
+    luaL_getmetatable(L, "UnitMT");
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
+    const char* scripts[] = { "function.lua", "data.lua" };
+    for(auto script : scripts)
+    {
+        if(luaL_loadfile(L, script) != LUA_OK || lua_pcall(L, 0, LUA_MULTRET, 0) != LUA_OK)
+        {
+            std::cout << "[C++] error loading " << script << " : " << lua_tostring(L, -1) << std::endl;
+            return false;
+        }
+    }
+    FunctionHandle::reloaded(L);
+    return true;
+}
+
+/**
+ * The work of one worker, the total damage of its part of the monsters.
+ */
+long long totalDamage(lua_State* L, int worker)
+{
+    int chunk = MONSTERS / WORKERS;
+    FunctionHandle total(L, "total_damage");
+    if(!total.push())
+    {
+        return -1;
+    }
+    lua_pushinteger(L, worker * chunk + 1);
+    lua_pushinteger(L, (worker + 1) * chunk);
+    lua_call(L, 2, 1);
+    long long damage = (long long) lua_tonumber(L, -1);
+    lua_pop(L, 1);
+    return damage;
+}
+
+double millisecondsSince(const Clock::time_point& start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct Worker
+{
+    int number;
+    pid_t pid;
+    // the worker writes a byte here when its work is done
+    int done;
+};
+
+/**
+ * Wait for the worker pid to write its byte on fd. Returns false if it exits without writing it,
+ * the worker has then been waited for already.
+ */
+bool waitReady(int fd, pid_t pid)
+{
+    pollfd entry = { fd, POLLIN, 0 };
+    while(true)
+    {
+        int polled = poll(&entry, 1, 100);
+        if(polled > 0)
+        {
+            char byte;
+            return read(fd, &byte, 1) == 1;
+        }
+        if(polled < 0 && errno != EINTR)
+        {
+            return false;
+        }
+        // nothing yet, the pipe stays open in the other workers so a dead one has to be asked for
+        if(waitpid(pid, 0, WNOHANG) == pid)
+        {
+            return false;
+        }
+    }
+}
+
+void printMemory(const std::string& name, pid_t pid)
+{
+    Zygote::Memory memory;
+    if(Zygote::memoryOf(pid, memory))
+    {
+        std::cout << "[C++] " << name << " : rss " << memory.rss << " kB, pss " << memory.pss << " kB, shared "
+            << memory.shared << " kB, private " << memory.privateMemory << " kB" << std::endl;
+    }
+    else
+    {
+        std::cout << "[C++] " << name << " : no /proc/" << pid << "/smaps_rollup" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // a worker started from nothing
+    double bootstrap = 0;
+    for(int i = 0; i < WORKERS; i++)
+    {
+        auto start = Clock::now();
+        lua_State* L = luaL_newstate();
+        bool ok = initState(L);
+        bootstrap += millisecondsSince(start);
+        if(!ok)
+        {
+            return 1;
+        }
+        lua_close(L);
+    }
+    std::cout << "[C++] full bootstrap : " << bootstrap / WORKERS << " ms per worker" << std::endl;
+
+    auto start = Clock::now();
+    Zygote zygote(initState);
+    if(!zygote.isReady())
+    {
+        return 1;
+    }
+    std::cout << "[C++] zygote ready in " << millisecondsSince(start) << " ms" << std::endl;
+
+    // each worker writes a byte to ready as soon as it runs (its copy of the state can be used from there,
+    // the byte is written before its first lua call), one to its own done pipe once its work is done,
+    // and stays alive until go is closed.
+    int ready[2];
+    int go[2];
+    if(pipe(ready) != 0 || pipe(go) != 0)
+    {
+        return 1;
+    }
+    std::vector<Worker> workers;
+    for(int worker = 0; worker < WORKERS; worker++)
+    {
+        int done[2];
+        if(pipe(done) != 0)
+        {
+            break;
+        }
+        start = Clock::now();
+        pid_t pid = zygote.spawn([&](lua_State* L)
+        {
+            close(go[1]);
+            char byte = 'r';
+            if(write(ready[1], &byte, 1) != 1)
+            {
+                return 1;
+            }
+            std::cout << "[C++] worker " << worker << " : total damage " << totalDamage(L, worker) << std::endl;
+            if(write(done[1], &byte, 1) != 1)
+            {
+                return 1;
+            }
+            // wait until the memory has been measured
+            while(read(go[0], &byte, 1) > 0)
+            {
+            }
+            return 0;
+        }, true);
+        // only the worker writes to its done pipe
+        close(done[1]);
+        if(pid < 0)
+        {
+            std::cout << "[C++] fork failed" << std::endl;
+            close(done[0]);
+            break;
+        }
+        if(!waitReady(ready[0], pid))
+        {
+            std::cout << "[C++] worker " << worker << " exited before it was ready" << std::endl;
+            close(done[0]);
+            continue;
+        }
+        std::cout << "[C++] worker " << worker << " ready to run lua in " << millisecondsSince(start) << " ms" << std::endl;
+        Worker spawned = { worker, pid, done[0] };
+        workers.push_back(spawned);
+    }
+
+    // measure once every worker has done its part, so their pages have been touched.
+    std::vector<Worker> finished;
+    for(auto& worker : workers)
+    {
+        if(waitReady(worker.done, worker.pid))
+        {
+            finished.push_back(worker);
+        }
+        else
+        {
+            std::cout << "[C++] worker " << worker.number << " exited before its work was done" << std::endl;
+        }
+        close(worker.done);
+    }
+    printMemory("zygote", getpid());
+    for(auto& worker : finished)
+    {
+        printMemory("worker " + std::to_string(worker.number), worker.pid);
+    }
+
+    // a worker that did not finish may not have been waited for yet, waiting twice only returns -1
+    close(go[1]);
+    for(auto& worker : workers)
+    {
+        Zygote::wait(worker.pid);
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <lua.hpp>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "lazylibs.hpp"
+
+/**
+ * Starting many states with all the libraries opened up front, and with lazylibs.
+ *
+ * Then a script using only string and math is run, and lazylibs tells which libraries it opened.
+ */
+
+static const int STATES = 1000;
+typedef std::chrono::steady_clock Clock;
+
+std::vector<luaL_Reg> libraries()
+{
+    std::vector<luaL_Reg> lualibs =
+        { {"base", luaopen_base} ,
+          {"io", luaopen_io} ,
+          {"string", luaopen_string} ,
+          {"table", luaopen_table} ,
+          {"math", luaopen_math} ,
+          {"os", luaopen_os} };
+    return lualibs;
+}
+
+void openEager(lua_State* L)
+{
+    for(auto& it : libraries())
+    {
+        luaL_requiref(L, it.name, it.func, 1);
+        lua_settop(L, 0);
+    }
+}
+
+void openLazy(lua_State* L)
+{
+    lazylibs::install(L, libraries());
+}
+
+/**
+ * Create STATES states and open the libraries in them, print the time and memory it takes.
+ */
+void startup(const std::string& name, void (*open)(lua_State*))
+{
+    std::vector<lua_State*> states;
+    auto start = Clock::now();
+    for(int i = 0; i < STATES; i++)
+    {
+        lua_State* L = luaL_newstate();
+        open(L);
+        states.push_back(L);
+    }
+    double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / STATES;
+    // memory used by lua in the state, in kB
+    int kb = lua_gc(states[0], LUA_GCCOUNT, 0);
+    std::cout << "[C++] " << name << " : " << us << " us and " << kb << " kB per state" << std::endl;
+    for(auto L : states)
+    {
+        lua_close(L);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    startup("eager", openEager);
+    startup("lazy", openLazy);
+
+    lua_State* L = luaL_newstate();
+    openLazy(L);
+    if(luaL_dofile(L, "script.lua") != LUA_OK)
+    {
+        std::cout << "[C++] error loading script : " << lua_tostring(L, -1) << std::endl;
+        return 1;
+    }
+    lua_getglobal(L, "describe");
+    lua_pushstring(L, "Hero");
+    lua_pushinteger(L, 15);
+    lua_call(L, 2, 1);
+    std::cout << "[C++] " << lua_tostring(L, -1) << std::endl;
+    lua_pop(L, 1);
+
+    lua_getglobal(L, "shout");
+    lua_pushstring(L, "charge");
+    lua_call(L, 1, 1);
+    std::cout << "[C++] " << lua_tostring(L, -1) << std::endl;
+    lua_pop(L, 1);
+
+    for(auto& usage : lazylibs::usage(L))
+    {
+        std::cout << "[C++] " << usage.library << " opened by " << usage.firstUser << " in " << usage.microseconds << " us" << std::endl;
+    }
+    for(auto& name : lazylibs::unused(L))
+    {
+        std::cout << "[C++] " << name << " never used" << std::endl;
+    }
+    lua_close(L);
+    return 0;
+}
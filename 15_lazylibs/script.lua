@@ -0,0 +1,10 @@
+-- only uses string and math, the other libraries are never opened.
+function describe(name, health)
+    local percent = math.floor(health * 100 / 20);
+    return string.format("%s has %d%% health", name, percent);
+end
+
+function shout(text)
+    -- a method call on a string, this needs the string library too.
+    return text:upper() .. "!";
+end
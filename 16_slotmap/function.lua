@@ -0,0 +1,24 @@
+-- the handles are kept between calls, like a script remembering its targets.
+targets = {};
+
+function remember(unit)
+    targets[#targets + 1] = unit;
+end
+
+-- hit every remembered unit that still exists, returns how many were hit.
+function hitAll(attacker)
+    local damage = attacker:getDamage();
+    local hit = 0;
+    for i = 1, #targets do
+        local target = targets[i];
+        if target:alive() then
+            target:dealtDamage(damage);
+            hit = hit + 1;
+        end
+    end
+    return hit;
+end
+
+function applyDamage(attacker, target)
+    target:dealtDamage(attacker:getDamage());
+end
@@ -0,0 +1,158 @@
+#include <lua.hpp>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "slotmap.hpp"
+
+/**
+ * Lua keeps references to units that C++ removes later.
+ *
+ * In part 5 the userdata holds a pointer, and a unit that is gone leaves lua with a dangling pointer.
+ * Here the units are in a SlotMap and lua gets handles: a removed unit is seen as not alive,
+ * and calling one of its methods is a lua error instead of a crash.
+ *
+ * Parts 4 and 5 still push pointers: their objects are owned by the C++ code around them,
+ * and userdatacache::invalidate (or classhierarchy's owned objects) covers them there.
+ */
+
+static const int UNITS = 1000000;
+
+class Unit
+{
+public:
+    Unit(const int& d = 1, const int& h = 20)
+        : damage(d), health(h)
+    {
+    }
+    int damage;
+    int health;
+
+    void dealtDamage(const int& damage)
+    {
+        health -= damage;
+        health = health < 0 ? 0 : health;
+    }
+
+    int getDamage()
+    {
+        return damage;
+    }
+};
+
+SlotMap<Unit> units;
+
+void putUnit(lua_State* L, SlotMap<Unit>::Handle handle)
+{
+    SlotMap<Unit>::push(L, handle, "UnitMT");
+}
+
+extern "C"
+{
+    static int function_unit_getDamage(lua_State* L)
+    {
+        lua_pushnumber(L, units.check(L, 1, "UnitMT")->getDamage());
+        return 1;
+    }
+
+    static int function_unit_dealtDamage(lua_State* L)
+    {
+        Unit* unit = units.check(L, 1, "UnitMT");
+        unit->dealtDamage(luaL_checkint(L, 2));
+        return 0;
+    }
+
+    static int function_unit_alive(lua_State* L)
+    {
+        lua_pushboolean(L, units.test(L, 1, "UnitMT") != 0);
+        return 1;
+    }
+}
+
+void loadWrapper(lua_State* L)
+{
+    luaL_newmetatable(L, "UnitMT");
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, function_unit_getDamage);
+    lua_setfield(L, -2, "getDamage");
+    lua_pushcfunction(L, function_unit_dealtDamage);
+    lua_setfield(L, -2, "dealtDamage");
+    lua_pushcfunction(L, function_unit_alive);
+    lua_setfield(L, -2, "alive");
+    lua_pop(L, 1);
+}
+
+void doThings(lua_State* L)
+{
+    typedef std::chrono::steady_clock Clock;
+    std::vector<SlotMap<Unit>::Handle> handles;
+    for(int i = 0; i < UNITS; i++)
+    {
+        handles.push_back(units.insert(Unit(1 + i % 5, 20)));
+    }
+    SlotMap<Unit>::Handle attacker = units.insert(Unit(3, 100));
+
+    // lua remembers every unit
+    for(auto handle : handles)
+    {
+        lua_getglobal(L, "remember");
+        putUnit(L, handle);
+        lua_call(L, 1, 0);
+    }
+
+    // half of them die, and new ones take their slots
+    for(int i = 0; i < UNITS; i += 2)
+    {
+        units.remove(handles[i]);
+    }
+    for(int i = 0; i < UNITS / 4; i++)
+    {
+        units.insert(Unit(2, 50));
+    }
+    std::cout << "[C++] " << units.size() << " units alive" << std::endl;
+
+    // the handles of the dead units don't reach the new units in their slots
+    auto start = Clock::now();
+    lua_getglobal(L, "hitAll");
+    putUnit(L, attacker);
+    lua_call(L, 1, 1);
+    int hit = (int) lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::cout << "[C++] lua hit " << hit << " of " << UNITS << " remembered units in " << ms << " ms" << std::endl;
+
+    // using a removed unit is an error, not a crash
+    lua_getglobal(L, "applyDamage");
+    putUnit(L, attacker);
+    putUnit(L, handles[0]);
+    if(lua_pcall(L, 2, 0, 0) != LUA_OK)
+    {
+        std::cout << "[C++] " << lua_tostring(L, -1) << std::endl;
+        lua_pop(L, 1);
+    }
+
+    // all the live units, in memory order
+    long long health = 0;
+    start = Clock::now();
+    for(auto& unit : units)
+    {
+        health += unit.health;
+    }
+    ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::cout << "[C++] total health " << health << ", counted in " << ms << " ms" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+    loadWrapper(L);
+    if(luaL_dofile(L, "function.lua") != LUA_OK)
+    {
+        std::cout << "[C++] error loading script : " << lua_tostring(L, -1) << std::endl;
+        return 1;
+    }
+    doThings(L);
+    lua_close(L);
+    return 0;
+}
@@ -2,32 +2,37 @@
 #include <iostream>
 #include <sstream>
 #include <vector>
+#include "luacall.hpp"
 
 
-// a multiple return.
-std::vector<int> multi(lua_State* L, int x, int y, int z)
+// the 3 values returned by multi.
+struct Sums
 {
-    std::vector<int> ints;
-    lua_getglobal(L, "multi"); 
-    if(lua_type(L, -1) == LUA_TFUNCTION)
-    {   
-        lua_pushnumber(L, x);
-        lua_pushnumber(L, y);
-        lua_pushnumber(L, z);
-        lua_call(L, 3, 3);
-        int xy = (int) lua_tointeger(L, -3);
-        int yz = (int) lua_tointeger(L, -2);
-        int xz = (int) lua_tointeger(L, -1);
-        lua_pop(L, 3);
-        ints.push_back(xy);
-        ints.push_back(yz);
-        ints.push_back(xz);
-    }
-    else
+    int xy;
+    int yz;
+    int xz;
+};
+
+// tell luacall how to read a Sums from the stack.
+namespace luacall
+{
+    template <>
+    struct Results<Sums>
     {
-        lua_pop(L, 1);
-    }
-    return ints;
+        static const int count = 3;
+        static bool get(lua_State* L, int first, Sums& sums)
+        {
+            return Result<int>::get(L, first, sums.xy)
+                && Result<int>::get(L, first + 1, sums.yz)
+                && Result<int>::get(L, first + 2, sums.xz);
+        }
+    };
+}
+
+// a multiple return, straight into a Sums instead of a std::vector.
+bool multi(FunctionHandle& function, int x, int y, int z, Sums& sums)
+{
+    return luacall::call(function, sums, x, y, z);
 }
 
 int main(int argc, char* argv[])
@@ -87,12 +92,25 @@ int main(int argc, char* argv[])
         std::cout << "[C++] Could not run the script." << std::endl;
     }
 
-    auto ints = multi(L, 1, 3, 5);
-    if(ints.size() == 3)
     {
-        std::cout << "[C++] X + Y : " << ints[0] << std::endl;
-        std::cout << "[C++] Y + Z : " << ints[1] << std::endl;
-        std::cout << "[C++] X + Z : " << ints[2] << std::endl;
+        // the handle must be gone before lua_close
+        FunctionHandle multiFunction(L, "multi");
+        Sums sums;
+        if(multi(multiFunction, 1, 3, 5, sums))
+        {
+            std::cout << "[C++] X + Y : " << sums.xy << std::endl;
+            std::cout << "[C++] Y + Z : " << sums.yz << std::endl;
+            std::cout << "[C++] X + Z : " << sums.xz << std::endl;
+        }
+
+        // or as a tuple, without declaring anything
+        std::tuple<int, int, int> ints;
+        if(luacall::call(multiFunction, ints, 2, 4, 6))
+        {
+            std::cout << "[C++] X + Y : " << std::get<0>(ints) << std::endl;
+            std::cout << "[C++] Y + Z : " << std::get<1>(ints) << std::endl;
+            std::cout << "[C++] X + Z : " << std::get<2>(ints) << std::endl;
+        }
     }
     lua_close(L);
     return 0;
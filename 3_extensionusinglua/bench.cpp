@@ -0,0 +1,95 @@
+#include <lua.hpp>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "callbudget.hpp"
+#include "damagefunction.hpp"
+#include "functionhandle.hpp"
+
+/**
+ * Compare calling a lua function by looking up its name every time
+ * against calling it through the DamageFunction main.cpp uses (a FunctionHandle and callbudget::pcall),
+ * one at a time, in batches and with a budget.
+ * goblin_damage_func is not pure, so DamageFunction calls it every time.
+ */
+
+static const int ITERATIONS = 10000000;
+
+// the way DamageFunction::getDamage used to do it.
+int callByName(lua_State* L, const std::string& name, int str)
+{
+    lua_getglobal(L, name.c_str());
+    if(lua_type(L, -1) != LUA_TFUNCTION)
+    {
+        lua_pop(L, 1);
+        return -1;
+    }
+    lua_pushnumber(L, str);
+    lua_call(L, 1, 1);
+    int damageValue = (int) lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    return damageValue;
+}
+
+template <typename F>
+void run(const std::string& label, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    long long sum = 0;
+    for(int i = 0; i < ITERATIONS; i++)
+    {
+        sum += f(i & 0xff);
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    // print the sum so the calls can't be optimized away
+    std::cout << label << " : " << (ns / ITERATIONS) << " ns/call (checksum " << sum << ")" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    lua_State* L = luaL_newstate();
+    luaL_requiref(L, "base", luaopen_base, 1);
+    lua_settop(L, 0);
+
+    if(luaL_dofile(L, "function.lua") != LUA_OK)
+    {
+        std::cout << "[C++] error loading script" << std::endl;
+        return 1;
+    }
+    FunctionHandle::reloaded(L);
+
+    {
+        const std::string name = "goblin_damage_func";
+        DamageFunction function(L, name);
+        DamageFunction budgeted(L, name);
+        budgeted.budget = callbudget::Budget(1000000, 1000);
+
+        run("name lookup", [&](int str) { return callByName(L, name, str); });
+        run("DamageFunction", [&](int str) { return function.getDamage(str); });
+        run("with budget", [&](int str) { return budgeted.getDamage(str); });
+
+        // batches of 1024, reported per element.
+        const int BATCH = 1024;
+        std::vector<int> strs(BATCH);
+        std::vector<int> damages(BATCH);
+        for(int i = 0; i < BATCH; i++)
+        {
+            strs[i] = i & 0xff;
+        }
+        auto start = std::chrono::steady_clock::now();
+        long long sum = 0;
+        for(int i = 0; i < ITERATIONS / BATCH; i++)
+        {
+            function.getDamage(strs.data(), damages.data(), BATCH);
+            sum += damages[i % BATCH];
+        }
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        std::cout << "batch : " << (ns / ((ITERATIONS / BATCH) * BATCH)) << " ns/call (checksum " << sum << ")" << std::endl;
+    }
+
+    lua_close(L);
+    return 0;
+}
@@ -0,0 +1,279 @@
+#ifndef DAMAGEFUNCTION_HPP
+#define DAMAGEFUNCTION_HPP
+#include <lua.hpp>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "callbudget.hpp"
+#include "functionhandle.hpp"
+#include "nativefunction.hpp"
+
+/**
+ * A damage function in the script.
+ *
+ * If the script lists the function in its "pure" table, the result only depends on the strength,
+ * so each result is kept and the function is only called once per strength:
+ *     pure = { snake_damage_func = true }
+ * With a range, the results for the whole range are worked out as soon as the script is loaded:
+ *     pure = { bear_damage_func = { from = 0, to = 100 } }
+ * The kept results are thrown away when the script is reloaded.
+ *
+ * With allowNative, a function that is only a formula of its parameter (like x + 2) is
+ * evaluated by a NativeFunction instead of entering lua at all.
+ */
+class DamageFunction
+{
+public:
+    DamageFunction(lua_State* state, const std::string& functionname)
+        : L(state), name(functionname), function(state, functionname), allowNative(false), pure(false), tableFrom(0), cacheGeneration(0)
+    {
+    }
+    lua_State* L;
+    std::string name;
+    // the lua function, looked up once instead of on every call.
+    FunctionHandle function;
+    // how long a single call may run, no limit by default.
+    callbudget::Budget budget;
+    // use the native version of the function when it has one
+    bool allowNative;
+
+    /**
+     * Get the damage based on hero's strength.
+     * Returns -1 if the function fails or runs out of budget.
+     */
+    int getDamage(const int& str)
+    {
+        int damageValue;
+        return getDamage(str, damageValue) ? damageValue : -1;
+    }
+
+    /**
+     * Same, but a failure is told apart from a damage of -1 : returns false and damage is left alone.
+     */
+    bool getDamage(const int& str, int& damage)
+    {
+        refresh();
+        if(allowNative && native.isCompiled() && native.arity() <= 1)
+        {
+            // converted like lua_tointeger does on 64 bit builds
+            damage = (int) (lua_Integer) native.call((lua_Number) str);
+            return true;
+        }
+        if(!pure)
+        {
+            return callFunction(str, damage);
+        }
+        if(str >= tableFrom && str - tableFrom < (int) table.size())
+        {
+            damage = table[str - tableFrom];
+            return true;
+        }
+        auto it = cache.find(str);
+        if(it != cache.end())
+        {
+            damage = it->second;
+            return true;
+        }
+        // failures are not kept, they may work next time
+        if(!callFunction(str, damage))
+        {
+            return false;
+        }
+        // once it is full the strengths seen first stay, the others are called every time.
+        if(cache.size() < MAX_CACHE)
+        {
+            cache[str] = damage;
+        }
+        return true;
+    }
+
+    bool isPure()
+    {
+        refresh();
+        return pure;
+    }
+
+    /**
+     * The formula of the function if it could be made native, or "".
+     */
+    std::string nativeFormula()
+    {
+        refresh();
+        return native.describe();
+    }
+
+    /**
+     * Get the damage for a batch of strengths.
+     * The function is put on the stack once, then each call only copies it and pushes the strength.
+     * damages must have room for count values. If the function can't be found, every damage is -1.
+     * This always calls the function, pure or not.
+     */
+    void getDamage(const int* strs, int* damages, size_t count)
+    {
+        if(!function.push())
+        {
+            std::cout << "Cannot find " << name << " function" << std::endl;
+            for(size_t i = 0; i < count; i++)
+            {
+                damages[i] = -1;
+            }
+            return;
+        }
+        for(size_t i = 0; i < count; i++)
+        {
+            if(!callCopy(strs[i], damages[i]))
+            {
+                damages[i] = -1;
+            }
+        }
+        // pop the function
+        lua_pop(L, 1);
+    }
+
+    void getDamage(const std::vector<int>& strs, std::vector<int>& damages)
+    {
+        damages.resize(strs.size());
+        if(!strs.empty())
+        {
+            getDamage(strs.data(), damages.data(), strs.size());
+        }
+    }
+
+private:
+    // the most results kept outside of the table
+    static const size_t MAX_CACHE = 4096;
+
+    bool pure;
+    // results for the strengths tableFrom, tableFrom + 1, ...
+    int tableFrom;
+    std::vector<int> table;
+    // results for the strengths outside of the table
+    std::unordered_map<int, int> cache;
+    // the generation of the script the results come from
+    unsigned cacheGeneration;
+    NativeFunction native;
+
+    /**
+     * After the script is (re)loaded, forget the results and read "pure" again.
+     */
+    void refresh()
+    {
+        if(cacheGeneration == function.currentGeneration())
+        {
+            return;
+        }
+        cacheGeneration = function.currentGeneration();
+        pure = false;
+        table.clear();
+        cache.clear();
+
+        if(function.push())
+        {
+            native.compile(L, -1);
+            lua_pop(L, 1);
+        }
+        else
+        {
+            native = NativeFunction();
+        }
+
+        lua_getglobal(L, "pure");
+        if(lua_istable(L, -1))
+        {
+            lua_getfield(L, -1, name.c_str());
+            pure = lua_toboolean(L, -1) != 0;
+            if(lua_istable(L, -1))
+            {
+                lua_getfield(L, -1, "from");
+                lua_getfield(L, -2, "to");
+                if(lua_isnumber(L, -2) && lua_isnumber(L, -1))
+                {
+                    tabulate((int) lua_tointeger(L, -2), (int) lua_tointeger(L, -1));
+                }
+                lua_pop(L, 2);
+            }
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+    }
+
+    void tabulate(int from, int to)
+    {
+        // more than this is probably a mistake in the script
+        const int MAX_TABLE = 1 << 16;
+        if(to < from || to - from >= MAX_TABLE)
+        {
+            std::cout << "[C++] " << name << " : can't tabulate from " << from << " to " << to << std::endl;
+            return;
+        }
+        tableFrom = from;
+        if(!function.push())
+        {
+            return;
+        }
+        // the table stops at the first failure, the rest are tried again one at a time
+        int damage;
+        for(int str = from; str <= to && callCopy(str, damage); str++)
+        {
+            table.push_back(damage);
+        }
+        // pop the function
+        lua_pop(L, 1);
+    }
+
+    bool callFunction(const int& str, int& damage)
+    {
+        if(function.push())
+        {
+            lua_pushnumber(L, str);
+            if(!call())
+            {
+                return false;
+            }
+            damage = (int) lua_tointeger(L, -1);
+            lua_pop(L, 1);
+            return true;
+        }
+        else
+        {
+            std::cout << "Cannot find " << name << " function" << std::endl;
+            return false;
+        }
+    }
+
+    /**
+     * Call the function on top of the stack, leaving it there for the next call.
+     */
+    bool callCopy(int str, int& damage)
+    {
+        // the call pops the function, so call a copy of it.
+        lua_pushvalue(L, -1);
+        lua_pushinteger(L, str);
+        if(!call())
+        {
+            return false;
+        }
+        damage = (int) lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        return true;
+    }
+
+    /**
+     * Call the function on the stack with 1 argument, within the budget.
+     * On failure the error is printed and popped, and false is returned.
+     */
+    bool call()
+    {
+        callbudget::Status status = callbudget::pcall(L, 1, 1, budget);
+        if(status != callbudget::OK)
+        {
+            std::cout << "[C++] " << name << (status == callbudget::TIMEOUT ? " timed out : " : " failed : ") << lua_tostring(L, -1) << std::endl;
+            lua_pop(L, 1);
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -5,3 +5,23 @@ end
 function bear_damage_func(x)
     return x * 2;
 end
+
+-- a broken function, it loops forever.
+function stuck_damage_func(x)
+    while true do
+        x = x + 1;
+    end
+    return x;
+end
+
+-- these only depend on x, so C++ can keep their results instead of calling them again.
+-- the bear's results from 0 to 100 are worked out as soon as the script is loaded.
+pure = {
+    snake_damage_func = true,
+    bear_damage_func = { from = 0, to = 100 },
+};
+
+-- not pure, but a simple formula.
+function goblin_damage_func(x)
+    return x * 3 - 1;
+end
@@ -1,40 +1,11 @@
 #include <lua.hpp>
+#include <chrono>
 #include <iostream>
 #include <sstream>
 #include <vector>
-
-class DamageFunction
-{
-public:
-    DamageFunction(lua_State* state, const std::string& functionname)
-        : L(state), name(functionname)
-    {
-    }
-    lua_State* L;
-    std::string name;
-
-    /**
-     * Get the damage based on hero's strength.
-     */
-    int getDamage(const int& str)
-    {
-        lua_getglobal(L, name.c_str());
-        int type = lua_type(L, -1);
-        if(type == LUA_TFUNCTION)
-        {
-            lua_pushnumber(L, str);
-            lua_call(L, 1, 1);
-            int damageValue = (int) lua_tointeger(L, -1);
-            lua_pop(L, 1);
-            return damageValue;
-        }
-        else
-        {
-            std::cout << "Cannot find " << name << " function" << std::endl;
-            return -1;
-        }
-    }
-};
+#include "callbudget.hpp"
+#include "damagefunction.hpp"
+#include "functionhandle.hpp"
 
 class Monster
 {
@@ -53,6 +24,92 @@ public:
     } 
 };
 
+/**
+ * A Simple function to load and run the file. Instead of just using luaL_dofile, I have split them up to print the proper error message.
+ */
+bool load(lua_State* L, const std::string& filename)
+{
+    // load the script
+    int status = luaL_loadfile(L, filename.c_str());
+    if(status != LUA_OK)
+    {
+        std::cout << "[C++] error loading script" << std::endl;
+        return false;
+    }
+    std::cout << "[C++] script loaded" << std::endl;
+
+    // run the script
+    int result = lua_pcall(L, 0, LUA_MULTRET, 0);
+    if(result != LUA_OK)
+    {
+        std::cout << "[C++] Could not run the script." << std::endl;
+        return false;
+    }
+    // the script may have redefined the functions, so the handles have to look them up again.
+    FunctionHandle::reloaded(L);
+    return true;
+}
+
+void doThings(lua_State* L)
+{
+    Monster snake1("Snake1", 4, DamageFunction(L, "snake_damage_func"));
+    Monster snake2("Snake2", 5, DamageFunction(L, "snake_damage_func"));
+    Monster bear1("Bear1", 5, DamageFunction(L, "bear_damage_func"));
+
+    std::cout << snake1.name << " : Str Value [" << snake1.strength << "] Dmg Value [" << snake1.getDamage()<< "]"<< std::endl;
+    std::cout << snake2.name << " : Str Value [" << snake2.strength << "] Dmg Value [" << snake2.getDamage()<< "]"<< std::endl;
+    std::cout << bear1.name << " : Str Value [" << bear1.strength << "] Dmg Value [" << bear1.getDamage()<< "]"<< std::endl;
+
+    // a whole pack of snakes in one go, the function is only looked up and put on the stack once.
+    std::vector<int> strengths = { 1, 2, 3, 4, 5 };
+    std::vector<int> damages;
+    DamageFunction snakeDamage(L, "snake_damage_func");
+    snakeDamage.getDamage(strengths, damages);
+    for(size_t i = 0; i < strengths.size(); i++)
+    {
+        std::cout << "Snake pack " << i << " : Str Value [" << strengths[i] << "] Dmg Value [" << damages[i] << "]" << std::endl;
+    }
+
+    // this one never returns, the budget stops it and the state can still be used after.
+    DamageFunction stuckDamage(L, "stuck_damage_func");
+    stuckDamage.budget = callbudget::Budget(1000000, 50);
+    Monster stuck("Stuck", 5, stuckDamage);
+    std::cout << stuck.name << " : Str Value [" << stuck.strength << "] Dmg Value [" << stuck.getDamage()<< "]"<< std::endl;
+    std::cout << snake1.name << " : Str Value [" << snake1.strength << "] Dmg Value [" << snake1.getDamage()<< "]"<< std::endl;
+
+    // the script says these are pure, after the first call (or the load, for the bear) they don't enter lua.
+    std::cout << "[C++] snake_damage_func pure : " << snake1.damageFunction.isPure() << ", bear_damage_func pure : " << bear1.damageFunction.isPure() << std::endl;
+    long long total = 0;
+    for(int i = 0; i < 1000000; i++)
+    {
+        total += bear1.damageFunction.getDamage(i % 100) + snake1.damageFunction.getDamage(i % 100);
+    }
+    std::cout << "[C++] total damage of a million hits : " << total << std::endl;
+
+    // goblin_damage_func is only a formula, so it can run without entering lua.
+    DamageFunction goblinDamage(L, "goblin_damage_func");
+    DamageFunction goblinNative(L, "goblin_damage_func");
+    goblinNative.allowNative = true;
+    std::cout << "[C++] goblin_damage_func native : " << goblinNative.nativeFormula() << std::endl;
+    std::cout << "[C++] stuck_damage_func native : " << stuckDamage.nativeFormula() << std::endl;
+    for(int native = 0; native < 2; native++)
+    {
+        DamageFunction& goblin = native ? goblinNative : goblinDamage;
+        auto start = std::chrono::steady_clock::now();
+        total = 0;
+        for(int i = 0; i < 1000000; i++)
+        {
+            total += goblin.getDamage(i % 100);
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "[C++] goblin " << (native ? "native" : "lua   ") << " : total " << total << " in " << ms << " ms" << std::endl;
+    }
+
+    // reloading throws the results away, they are worked out again from the new script.
+    load(L, "function.lua");
+    std::cout << bear1.name << " : Str Value [" << bear1.strength << "] Dmg Value [" << bear1.getDamage()<< "]"<< std::endl;
+}
+
 int main(int argc, char* argv[])
 {
     // create a new Lua state.
@@ -71,34 +128,13 @@ int main(int argc, char* argv[])
     }
 
     // load the script
-    int status = luaL_loadfile(L, "function.lua");
-    if(status == 0) // okay 
+    if(!load(L, "function.lua"))
     {
-        std::cout << "[C++] script loaded" << std::endl;
-    }
-    else
-    {
-        std::cout << "[C++] error loading script" << std::endl;
-        return 1;
-    }
-
-    int result = result = lua_pcall(L, 0, LUA_MULTRET, 0);
-    if(status == LUA_OK)
-    {
-    }
-    else
-    {
-        std::cout << "[C++] Could not run the script." << std::endl;
         return 1;
     }
 
-    Monster snake1("Snake1", 4, DamageFunction(L, "snake_damage_func"));
-    Monster snake2("Snake2", 5, DamageFunction(L, "snake_damage_func"));
-    Monster bear1("Bear1", 5, DamageFunction(L, "bear_damage_func"));
-
-    std::cout << snake1.name << " : Str Value [" << snake1.strength << "] Dmg Value [" << snake1.getDamage()<< "]"<< std::endl;
-    std::cout << snake2.name << " : Str Value [" << snake2.strength << "] Dmg Value [" << snake2.getDamage()<< "]"<< std::endl;
-    std::cout << bear1.name << " : Str Value [" << bear1.strength << "] Dmg Value [" << bear1.getDamage()<< "]"<< std::endl;
+    // the monsters hold registry references, so they are created and destroyed before the state is closed.
+    doThings(L);
 
     lua_close(L);
     return 0;
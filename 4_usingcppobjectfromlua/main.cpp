@@ -4,6 +4,10 @@
 #include <vector>
 #include <string>
 #include <assert.h>
+#include "binder.hpp"
+#include "callbudget.hpp"
+#include "functionhandle.hpp"
+#include "userdatacache.hpp"
 /*****
  * Tutorial concept taken from 
  * http://rubenlaguna.com/wp/2012/12/09/accessing-cpp-objects-from-lua/
@@ -44,10 +48,9 @@ public:
 
 void putCharacter(lua_State* L, Character& character)
 {
-    Character** userdata = static_cast<Character**>(lua_newuserdata(L, sizeof(Character*)));
-    *userdata = &character;
-    // set the attacker metatable
-    luaL_setmetatable(L, "CharacterMT");
+    // reuse the userdata if this character has been passed to lua before,
+    // else create a new one pointing to the character, with the "CharacterMT" metatable.
+    userdatacache::push(L, &character, "CharacterMT");
 }
 
 /**
@@ -58,11 +61,15 @@ class ApplyDamageFunction
 {
 public:
     ApplyDamageFunction(lua_State* state, const std::string& functionname)
-        : L(state), name(functionname)
+        : L(state), name(functionname), function(state, functionname)
     {
     }
     lua_State* L;
     std::string name;
+    // the lua function, looked up once instead of on every call.
+    FunctionHandle function;
+    // how long a single call may run, no limit by default.
+    callbudget::Budget budget;
 
     /**
      * This method mirrors the function in the lua script.
@@ -70,16 +77,19 @@ public:
     void applyDamage(Character& attacker, Character& defender)
     {
         // put the function on the stack
-        lua_getglobal(L, name.c_str());
-        int type = lua_type(L, -1);
-        if(type == LUA_TFUNCTION)
+        if(function.push())
         {
             // create a new user data on the stack, and assign the attacker pointer to it
             putCharacter(L, attacker);
             // create a new user data on the stack, and assign the defender pointer to it
             putCharacter(L, defender);
-            // call the function
-            lua_call(L, 2, 0);
+            // call the function, a script that errors or runs too long is stopped instead of taking us down.
+            callbudget::Status status = callbudget::pcall(L, 2, 0, budget);
+            if(status != callbudget::OK)
+            {
+                std::cout << "[C++] " << name << (status == callbudget::TIMEOUT ? " timed out : " : " failed : ") << lua_tostring(L, -1) << std::endl;
+                lua_pop(L, 1);
+            }
             // shouldn't have anything to pop
             assert(lua_gettop(L) == 0);
         }
@@ -90,36 +100,37 @@ public:
     }
 };
 
-extern "C" 
+/**
+ * How the generated wrappers get the character from the first argument ("self").
+ */
+namespace binder
 {
-    //// wrapper method for character /////
-    static int function_character_getDamage(lua_State* L)
+    template <>
+    struct Self<Character>
     {
-        // get the user data , pointer to the pointer of character object.
-        Character ** character = static_cast<Character**>(luaL_checkudata(L, 1, "CharacterMT"));
-        // put the damage value onto the stack.
-        int damage = (**character).getDamage();
-        lua_pushnumber(L, damage);
-        return 1; // the number of values we put into the lua stack. Not the return value
-    }
-
-    static int function_character_dealtDamage(lua_State* L)
-    {
-        // get the user data , pointer to the pointer of character object.
-        Character ** character = static_cast<Character**>(luaL_checkudata(L, 1, "CharacterMT"));
-        // get the damage to be dealt to this char.
-        int damage = luaL_checkint(L, 2);
-        // deals the damage
-        (**character).dealtDamage(damage);
-        return 0; // the number of values we put into the lua stack. Not the return value
-    }
+        static Character* get(lua_State* L, int index)
+        {
+            // get the user data , pointer to the pointer of character object.
+            Character ** character = static_cast<Character**>(luaL_checkudata(L, index, "CharacterMT"));
+            // the pointer is null if the character has been destroyed
+            luaL_argcheck(L, *character != 0, index, "character has been destroyed");
+            return *character;
+        }
+    };
+}
 
+extern "C" 
+{
+    //// wrapper method for character /////
+    // getDamage and dealtDamage are generated by LUA_BIND, see doThings.
+    // health is both a getter and a setter, so it is still written by hand.
     static int function_character_health(lua_State* L)
     {
         int args = lua_gettop(L);
         if(args == 1) // if there are no argument other than self, we will just return the health value
         {
             Character ** character = static_cast<Character**>(luaL_checkudata(L, 1, "CharacterMT"));
+            luaL_argcheck(L, *character != 0, 1, "character has been destroyed");
             int health = (**character).health;
             lua_pushnumber(L, health);
             return 1;
@@ -127,6 +138,7 @@ extern "C"
         else // else, we will set the value to the first argument after "self"
         {
             Character ** character = static_cast<Character**>(luaL_checkudata(L, 1, "CharacterMT"));
+            luaL_argcheck(L, *character != 0, 1, "character has been destroyed");
             int health = luaL_checkint(L, 2);
             (**character).health = health;
             lua_pushnumber(L, health);
@@ -143,15 +155,14 @@ void doThings(lua_State* L)
     // set the meta table of the character meta table to be itself
     lua_pushvalue(L, -1);
     lua_setfield(L, -2, "__index");
-    // set the get damage function
-    lua_pushcfunction(L, function_character_getDamage);
-    lua_setfield(L, -2, "getDamage");
-    // set the dealt damage function
-    lua_pushcfunction(L, function_character_dealtDamage);
-    lua_setfield(L, -2, "dealtDamage");
-
-    lua_pushcfunction(L, function_character_health);
-    lua_setfield(L, -2, "health");
+    // the methods, the wrappers of getDamage and dealtDamage are generated from the member functions.
+    const luaL_Reg methods[] = {
+        LUA_BIND("getDamage", &Character::getDamage),
+        LUA_BIND("dealtDamage", &Character::dealtDamage),
+        { "health", function_character_health },
+        { 0, 0 }
+    };
+    luaL_setfuncs(L, methods, 0);
 
     // pop the meta table from the stack
     lua_pop(L, 1);
@@ -171,6 +182,10 @@ void doThings(lua_State* L)
 
     // print the state after the call 
     std::cout << "[C++] [After damage]  Attacker Hp : " << attacker.health << " Defender Hp : " << defender.health << std::endl;
+
+    // the characters die at the end of this function, lua must not use them after that.
+    userdatacache::invalidate(L, &attacker, "CharacterMT");
+    userdatacache::invalidate(L, &defender, "CharacterMT");
 }
 
 int main(int argc, char* argv[])
@@ -14,3 +14,12 @@ function testcharacter(character)
     local newhealth = character:health(3);
     print("[Lua] After setting health value  " .. newhealth);
 end
+
+-- units made by lua, they are not pointers to C++ objects but live in the userdata.
+function testowned(attacker)
+    local minion = newUnit(2, 15);
+    local hero = newCharacter("Hero", 4, 30);
+    applyDamage(attacker, minion);
+    applyDamage(hero, minion);
+    print("[Lua] minion health " .. minion:health() .. ", hero health " .. hero:health());
+end
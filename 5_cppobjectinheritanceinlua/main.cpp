@@ -4,6 +4,12 @@
 #include <vector>
 #include <string>
 #include <assert.h>
+#include "callbudget.hpp"
+#include "functionhandle.hpp"
+#include "trace.hpp"
+#include "traceevents.hpp"
+#include "classhierarchy.hpp"
+#include "userdatacache.hpp"
 /*****
  * Tutorial concept taken from 
  * http://rubenlaguna.com/wp/2012/12/09/accessing-cpp-objects-from-lua/
@@ -53,19 +59,24 @@ public:
     }
 };
 
+/**
+ * The classes that lua knows about. Each userdata carries the tag of its class,
+ * so the wrappers check the type with one read instead of a luaL_testudata per class.
+ */
+ClassHierarchy<Unit> hierarchy;
+ClassHierarchy<Unit>::Tag UnitTag = hierarchy.add("UnitMT");
+ClassHierarchy<Unit>::Tag CharacterTag = hierarchy.add("CharacterMT", UnitTag);
+
+// C++ owns these objects, lua only gets a pointer to them.
+// both reuse the userdata if the object has been passed to lua before.
 void putCharacter(lua_State* L, Character& character)
 {
-    Character** userdata = static_cast<Character**>(lua_newuserdata(L, sizeof(Character*)));
-    *userdata = &character;
-    // set the attacker metatable
-    luaL_setmetatable(L, "CharacterMT");
+    hierarchy.push(L, &character, CharacterTag);
 }
 
 void putUnit(lua_State* L, Unit& unit)
 {
-    Unit** userdata = static_cast<Unit**>(lua_newuserdata(L, sizeof(Unit*)));
-    *userdata = &unit;
-    luaL_setmetatable(L, "UnitMT");
+    hierarchy.push(L, &unit, UnitTag);
 }
 
 /**
@@ -76,11 +87,15 @@ class ApplyDamageFunction
 {
 public:
     ApplyDamageFunction(lua_State* state, const std::string& functionname)
-        : L(state), name(functionname)
+        : L(state), name(functionname), function(state, functionname)
     {
     }
     lua_State* L;
     std::string name;
+    // the lua function, looked up once instead of on every call.
+    FunctionHandle function;
+    // how long a single call may run, no limit by default.
+    callbudget::Budget budget;
 
     /**
      * This method mirrors the function in the lua script.
@@ -88,16 +103,19 @@ public:
     void applyDamage(Character& attacker, Character& defender)
     {
         // put the function on the stack
-        lua_getglobal(L, name.c_str());
-        int type = lua_type(L, -1);
-        if(type == LUA_TFUNCTION)
+        if(function.push())
         {
             // create a new user data on the stack, and assign the attacker pointer to it
             putCharacter(L, attacker);
             // create a new user data on the stack, and assign the defender pointer to it
             putCharacter(L, defender);
-            // call the function
-            lua_call(L, 2, 0);
+            // call the function, a script that errors or runs too long is stopped instead of taking us down.
+            callbudget::Status status = callbudget::pcall(L, 2, 0, budget);
+            if(status != callbudget::OK)
+            {
+                std::cout << "[C++] " << name << (status == callbudget::TIMEOUT ? " timed out : " : " failed : ") << lua_tostring(L, -1) << std::endl;
+                lua_pop(L, 1);
+            }
             // shouldn't have anything to pop
             assert(lua_gettop(L) == 0);
         }
@@ -110,23 +128,36 @@ public:
 
 extern "C" 
 {
-    //// wrapper method for character /////
+    //// constructors for lua, the object is stored in the userdata and lua owns it ////
+    static int function_unit_new(lua_State* L)
+    {
+        int damage = luaL_optint(L, 1, 1);
+        int health = luaL_optint(L, 2, 20);
+        hierarchy.create<Unit>(L, UnitTag, damage, health);
+        return 1;
+    }
+
+    static int function_character_new(lua_State* L)
+    {
+        // every argument is read before anything with a destructor exists, a lua error would skip it.
+        // the std::string for the name is only made by the constructor, inside the userdata.
+        const char* name = luaL_checkstring(L, 1);
+        int damage = luaL_optint(L, 2, 1);
+        int health = luaL_optint(L, 3, 20);
+        hierarchy.create<Character>(L, CharacterTag, name, damage, health);
+        return 1;
+    }
+
+    //// wrapper method for unit, character uses the same methods /////
     static int function_unit_getDamage(lua_State* L)
     {
-        // test which class called this method.
-        // sadly we have to do double checking here.
-        Unit** unit = static_cast<Unit**>(luaL_testudata(L, 1, "UnitMT"));
-        Character** character = static_cast<Character**>(luaL_testudata(L, 1, "CharacterMT"));
-        std::cout << "[C++]" << "calling method \"getDamage\"" << std::endl;
-        std::cout << "[C++] Class type is : " << (unit ? "Unit" : "Character") << std::endl;
-        if(character)
-        {
-            int damage = (**character).getDamage();
-            lua_pushnumber(L, damage);
-        }
-        else if(unit)
+        // one check accepts a Unit or anything derived from it.
+        Unit* unit = hierarchy.test(L, 1, UnitTag);
+        TRACE(TRACE_DEBUG, EVENT_CALLING_METHOD, METHOD_GETDAMAGE);
+        TRACE(TRACE_DEBUG, EVENT_CLASS_TYPE, hierarchy.tagOf(L, 1));
+        if(unit)
         {
-            int damage = (**unit).getDamage();
+            int damage = unit->getDamage();
             lua_pushnumber(L, damage);
         }
         else
@@ -139,41 +170,31 @@ extern "C"
 
     static int function_unit_dealtDamage(lua_State* L)
     {
-        // get the user data , pointer to the pointer of character object.
-        Unit** unit = static_cast<Unit**>(luaL_testudata(L, 1, "UnitMT"));
-        Character** character = static_cast<Character**>(luaL_testudata(L, 1, "CharacterMT"));
+        // get the unit, null if it is not a unit or has been destroyed.
+        Unit* unit = hierarchy.test(L, 1, UnitTag);
         // get the damage to be dealt to this char.
-        std::cout << "[C++]" << "calling method \"dealtDamage\"" << std::endl;
-        std::cout << "[C++] Class type is : " << (unit ? "Unit" : "Character") << std::endl;
+        TRACE(TRACE_DEBUG, EVENT_CALLING_METHOD, METHOD_DEALTDAMAGE);
+        TRACE(TRACE_DEBUG, EVENT_CLASS_TYPE, hierarchy.tagOf(L, 1));
         int damage = luaL_checkint(L, 2);
-        if(character)
-        {
-            (**character).dealtDamage(damage);
-        }
-        else if(unit)
+        if(unit)
         {
-            (**unit).dealtDamage(damage);
+            // deals the damage
+            unit->dealtDamage(damage);
         }
-        // deals the damage
         return 0; // the number of values we put into the lua stack. Not the return value
     }
 
     static int function_unit_health(lua_State* L)
     {
         int args = lua_gettop(L);
-        Unit** unit = static_cast<Unit**>(luaL_testudata(L, 1, "UnitMT"));
-        Character** character = static_cast<Character**>(luaL_testudata(L, 1, "CharacterMT"));
-        std::cout << "[C++]" << "calling method \"health\"" << std::endl;
-        std::cout << "[C++] Class type is : " << (unit ? "Unit" : "Character") << std::endl;
+        Unit* unit = hierarchy.test(L, 1, UnitTag);
+        TRACE(TRACE_DEBUG, EVENT_CALLING_METHOD, METHOD_HEALTH);
+        TRACE(TRACE_DEBUG, EVENT_CLASS_TYPE, hierarchy.tagOf(L, 1));
         if(args == 1) // if there are no argument other than self, we will just return the health value
         {
             if(unit)
             {
-                lua_pushnumber(L, (**unit).health);
-            }
-            else if(character)
-            {
-                lua_pushnumber(L, (**character).health);
+                lua_pushnumber(L, unit->health);
             }
             else
             {
@@ -186,12 +207,7 @@ extern "C"
             int health = luaL_checkint(L, 2);
             if(unit)
             {
-                (**unit).health = health;
-                lua_pushnumber(L, health);
-            }
-            else if(character)
-            {
-                (**character).health = health;
+                unit->health = health;
                 lua_pushnumber(L, health);
             }
             else
@@ -230,6 +246,14 @@ void doThings(lua_State* L)
     // pop the meta table from the stack
     lua_pop(L, 1);
 
+    // marks the metatables for the type checks, and adds the __gc that destroys the objects created by lua,
+    // so it has to be done before any of them is pushed or made.
+    hierarchy.install(L);
+    lua_pushcfunction(L, function_unit_new);
+    lua_setglobal(L, "newUnit");
+    lua_pushcfunction(L, function_character_new);
+    lua_setglobal(L, "newCharacter");
+
     // create the 2 character
     Character attacker("Attacker", 3, 10);
     Unit defender(1, 20);
@@ -262,6 +286,18 @@ void doThings(lua_State* L)
     lua_getglobal(L, "testcharacter");
     putUnit(L, defender);
     lua_call(L, 1, 0);
+
+    // lua makes its own units, they live inside their userdata.
+    lua_getglobal(L, "testowned");
+    putCharacter(L, attacker);
+    lua_call(L, 1, 0);
+    // the minion is garbage now, collecting it runs its destructor.
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    std::cout << "[C++] the units made by lua have been collected" << std::endl;
+
+    // the objects die at the end of this function, lua must not use them after that.
+    userdatacache::invalidate(L, &attacker, "CharacterMT");
+    userdatacache::invalidate(L, &defender, "UnitMT");
 }
 
 int main(int argc, char* argv[])
@@ -305,6 +341,10 @@ int main(int argc, char* argv[])
 
     doThings(L);
 
+#if TRACE_LEVEL > 0
+    // read it with ./tracedecode
+    trace::dump("trace.bin");
+#endif
 
     lua_close(L);
     return 0;
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "trace.hpp"
+#include "traceevents.hpp"
+
+/**
+ * Print a trace file written by "make TRACE=3" builds of this example,
+ * with the same lines that the wrappers used to print with std::cout.
+ *
+ * usage : ./tracedecode [trace.bin] [-t]
+ * -t prefixes each line with the time in microseconds since the first record, and the thread.
+ */
+template <size_t N>
+const char* nameOf(const char* const (&names)[N], uint16_t index)
+{
+    return index < N ? names[index] : "?";
+}
+
+int main(int argc, char* argv[])
+{
+    std::string filename = "trace.bin";
+    bool times = false;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if(arg == "-t")
+        {
+            times = true;
+        }
+        else
+        {
+            filename = arg;
+        }
+    }
+
+    std::vector<trace::Record> records;
+    if(!trace::load(filename.c_str(), records))
+    {
+        std::cout << "cannot read " << filename << std::endl;
+        return 1;
+    }
+    for(auto& r : records)
+    {
+        if(times)
+        {
+            std::cout << ((r.time - records[0].time) / 1000.0) << "us [" << r.thread << "] ";
+        }
+        switch(r.event)
+        {
+        case EVENT_CALLING_METHOD:
+            std::cout << "[C++]" << "calling method \"" << nameOf(traceMethodNames, r.arg) << "\"" << std::endl;
+            break;
+        case EVENT_CLASS_TYPE:
+            std::cout << "[C++] Class type is : " << nameOf(traceClassNames, r.arg) << std::endl;
+            break;
+        default:
+            std::cout << "unknown event " << r.event << std::endl;
+        }
+    }
+    return 0;
+}
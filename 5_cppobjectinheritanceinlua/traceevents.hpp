@@ -0,0 +1,27 @@
+#ifndef TRACEEVENTS_HPP
+#define TRACEEVENTS_HPP
+#include <cstdint>
+
+/**
+ * The trace events of this example, shared by main.cpp and the decoder.
+ */
+enum TraceEvent : uint16_t
+{
+    // arg is a TraceMethod
+    EVENT_CALLING_METHOD,
+    // arg is the class tag of self
+    EVENT_CLASS_TYPE,
+};
+
+enum TraceMethod : uint16_t
+{
+    METHOD_GETDAMAGE,
+    METHOD_DEALTDAMAGE,
+    METHOD_HEALTH,
+};
+
+static const char* const traceMethodNames[] = { "getDamage", "dealtDamage", "health" };
+// in the order the classes are added to the hierarchy.
+static const char* const traceClassNames[] = { "Unit", "Character" };
+
+#endif
@@ -0,0 +1,7 @@
+function snake_damage_func(x)
+    return x + 2;
+end
+
+function bear_damage_func(x)
+    return x * 2;
+end
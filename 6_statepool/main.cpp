@@ -0,0 +1,161 @@
+#include <lua.hpp>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "functionhandle.hpp"
+#include "lazylibs.hpp"
+#include "statepool.hpp"
+
+/**
+ * Same as part 3, but the monsters are evaluated on multiple threads.
+ * Each thread gets its own lua_State with function.lua loaded in it, so nothing in lua is shared.
+ */
+
+class DamageFunction
+{
+public:
+    DamageFunction(lua_State* state, const std::string& functionname)
+        : L(state), name(functionname), function(state, functionname)
+    {
+    }
+    lua_State* L;
+    std::string name;
+    FunctionHandle function;
+
+    /**
+     * Get the damage based on hero's strength.
+     */
+    int getDamage(const int& str)
+    {
+        if(function.push())
+        {
+            lua_pushinteger(L, str);
+            lua_call(L, 1, 1);
+            int damageValue = (int) lua_tointeger(L, -1);
+            lua_pop(L, 1);
+            return damageValue;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+};
+
+enum MonsterType
+{
+    Snake,
+    Bear,
+};
+
+/**
+ * The monster only knows which kind of damage function it uses.
+ * The function itself belongs to a state, and there is one state per thread.
+ */
+class Monster
+{
+public:
+    Monster(const MonsterType& t, const int& str)
+        : type(t), strength(str)
+    {
+    }
+    MonsterType type;
+    int strength;
+};
+
+/**
+ * Load the libraries and the script into a new state, this is run once for every state in the pool.
+ * Only base is opened here, the others are opened by the first script that uses them.
+ */
+bool initState(lua_State* L)
+{
+    std::vector<luaL_Reg> lualibs =
+        { {"base", luaopen_base} ,
+          {"io", luaopen_io} ,
+          {"string", luaopen_string} ,
+          {"table", luaopen_table} ,
+          {"math", luaopen_math} ,
+          {"os", luaopen_os} };
+    lazylibs::install(L, lualibs);
+    if(luaL_loadfile(L, "function.lua") != LUA_OK || lua_pcall(L, 0, LUA_MULTRET, 0) != LUA_OK)
+    {
+        std::cout << "[C++] error loading script" << std::endl;
+        return false;
+    }
+    FunctionHandle::reloaded(L);
+    return true;
+}
+
+/**
+ * Work out the damage of monsters [begin, end) using the state of one worker.
+ */
+void computeDamages(lua_State* L, const std::vector<Monster>& monsters, std::vector<int>& damages, size_t begin, size_t end)
+{
+    // the handles are per state, so each worker makes its own.
+    DamageFunction snake(L, "snake_damage_func");
+    DamageFunction bear(L, "bear_damage_func");
+    for(size_t i = begin; i < end; i++)
+    {
+        const Monster& monster = monsters[i];
+        damages[i] = monster.type == Snake ? snake.getDamage(monster.strength) : bear.getDamage(monster.strength);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t cores = std::thread::hardware_concurrency();
+    if(cores == 0)
+    {
+        cores = 1;
+    }
+    const size_t monsterCount = 2000000;
+
+    StatePool pool(cores, initState);
+    if(!pool.isReady())
+    {
+        return 1;
+    }
+    std::cout << "[C++] " << pool.size() << " states loaded" << std::endl;
+
+    std::vector<Monster> monsters;
+    monsters.reserve(monsterCount);
+    for(size_t i = 0; i < monsterCount; i++)
+    {
+        monsters.push_back(Monster(i % 3 == 0 ? Bear : Snake, (int) (i % 50)));
+    }
+    std::vector<int> damages(monsterCount);
+
+    // the scaling curve, from 1 thread up to all the cores.
+    double single = 0;
+    for(size_t workers = 1; workers <= cores; workers++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        pool.parallelFor(monsters.size(), workers, [&](size_t worker, lua_State* L, size_t begin, size_t end)
+        {
+            computeDamages(L, monsters, damages, begin, end);
+        });
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        double throughput = monsterCount / seconds;
+        if(workers == 1)
+        {
+            single = throughput;
+        }
+        std::cout << "[C++] " << workers << " thread(s) : " << (long long) throughput << " monsters/s, speedup x" << (throughput / single) << std::endl;
+    }
+
+    for(auto& usage : lazylibs::usage(pool.get(0)))
+    {
+        std::cout << "[C++] " << usage.library << " opened by " << usage.firstUser << " in " << usage.microseconds << " us" << std::endl;
+    }
+    for(auto& name : lazylibs::unused(pool.get(0)))
+    {
+        std::cout << "[C++] " << name << " never used" << std::endl;
+    }
+
+    std::cout << "[C++] Monster 0 (Bear) : Str Value [" << monsters[0].strength << "] Dmg Value [" << damages[0] << "]" << std::endl;
+    std::cout << "[C++] Monster 1 (Snake) : Str Value [" << monsters[1].strength << "] Dmg Value [" << damages[1] << "]" << std::endl;
+    return 0;
+}
@@ -0,0 +1,5 @@
+-- same as part 5, without the prints so that the allocations are what we measure.
+function applyDamage(attacker, target)
+    local damage = attacker:getDamage();
+    target:dealtDamage(damage);
+end
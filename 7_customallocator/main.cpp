@@ -0,0 +1,171 @@
+#include <lua.hpp>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "functionhandle.hpp"
+#include "poolallocator.hpp"
+#include "userdatacache.hpp"
+
+/**
+ * Every time a unit is passed to lua, putUnit creates a new userdata, which lua
+ * allocates and later frees. This runs the same applyDamage loop on a state using the default
+ * allocator and on a state using the PoolAllocator, and prints what the allocator saw.
+ * Then it runs once more with the userdata cache, where the same 2 userdata are reused for every call.
+ */
+
+class Unit 
+{
+public:
+    Unit(const int& d = 1, const int& h = 20)
+        : damage(d), health(h)
+    {
+    }
+    int damage;
+    int health;
+
+    void dealtDamage(const int& damage)
+    {
+        health -= damage;
+        health = health < 0 ? 0 : health;
+    }
+
+    int getDamage() 
+    {
+        return damage;
+    }
+};
+
+void putUnit(lua_State* L, Unit& unit)
+{
+    Unit** userdata = static_cast<Unit**>(lua_newuserdata(L, sizeof(Unit*)));
+    *userdata = &unit;
+    luaL_setmetatable(L, "UnitMT");
+}
+
+void putUnitCached(lua_State* L, Unit& unit)
+{
+    userdatacache::push(L, &unit, "UnitMT");
+}
+
+typedef void (*PutUnit)(lua_State*, Unit&);
+
+extern "C"
+{
+    static int function_unit_getDamage(lua_State* L)
+    {
+        Unit** unit = static_cast<Unit**>(luaL_checkudata(L, 1, "UnitMT"));
+        lua_pushnumber(L, (**unit).getDamage());
+        return 1;
+    }
+
+    static int function_unit_dealtDamage(lua_State* L)
+    {
+        Unit** unit = static_cast<Unit**>(luaL_checkudata(L, 1, "UnitMT"));
+        int damage = luaL_checkint(L, 2);
+        (**unit).dealtDamage(damage);
+        return 0;
+    }
+}
+
+/**
+ * Load the libraries, the unit metatable and the script.
+ */
+bool initState(lua_State* L)
+{
+    std::vector<luaL_Reg> lualibs =
+        { {"base", luaopen_base} ,
+          {"io", luaopen_io} };
+    for(auto& it : lualibs)
+    {
+        luaL_requiref(L, it.name, it.func, 1);
+        lua_settop(L, 0);
+    }
+
+    luaL_newmetatable(L, "UnitMT");
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, function_unit_getDamage);
+    lua_setfield(L, -2, "getDamage");
+    lua_pushcfunction(L, function_unit_dealtDamage);
+    lua_setfield(L, -2, "dealtDamage");
+    lua_pop(L, 1);
+
+    if(luaL_loadfile(L, "function.lua") != LUA_OK || lua_pcall(L, 0, LUA_MULTRET, 0) != LUA_OK)
+    {
+        std::cout << "[C++] error loading script" << std::endl;
+        return false;
+    }
+    FunctionHandle::reloaded(L);
+    return true;
+}
+
+/**
+ * Run applyDamage calls back and forth between 2 units, returns the time it took in seconds.
+ */
+double runTicks(lua_State* L, int calls, PutUnit put)
+{
+    FunctionHandle applyDamage(L, "applyDamage");
+    Unit unit1(0, 30);
+    Unit unit2(0, 40);
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < calls; i++)
+    {
+        if(!applyDamage.push())
+        {
+            std::cout << "Cannot find applyDamage function" << std::endl;
+            break;
+        }
+        put(L, i % 2 ? unit1 : unit2);
+        put(L, i % 2 ? unit2 : unit1);
+        lua_call(L, 2, 0);
+    }
+    auto end = std::chrono::steady_clock::now();
+    userdatacache::invalidate(L, &unit1, "UnitMT");
+    userdatacache::invalidate(L, &unit2, "UnitMT");
+    return std::chrono::duration<double>(end - start).count();
+}
+
+void runWithPool(const std::string& label, int calls, PutUnit put)
+{
+    // the allocator must live longer than the state.
+    PoolAllocator allocator;
+    lua_State* L = allocator.newState();
+    if(!initState(L))
+    {
+        lua_close(L);
+        return;
+    }
+    PoolAllocator::Stats before = allocator.getStats();
+    double seconds = runTicks(L, calls, put);
+    const PoolAllocator::Stats& after = allocator.getStats();
+    std::cout << "[C++] " << label << " : " << (seconds * 1e9 / calls) << " ns/call" << std::endl;
+    std::cout << "[C++]   bytes in use : " << after.bytesInUse << " (peak " << after.peakBytes << ", reserved for small blocks " << allocator.reservedBytes() << ")" << std::endl;
+    std::cout << "[C++]   allocations during the run : " << (after.allocations - before.allocations)
+              << " (" << (after.poolHits - before.poolHits) << " from the free lists)" << std::endl;
+    std::cout << "[C++]   frees during the run : " << (after.frees - before.frees) << std::endl;
+    std::cout << "[C++]   reallocations during the run : " << (after.reallocations - before.reallocations) << std::endl;
+    lua_close(L);
+}
+
+int main(int argc, char* argv[])
+{
+    const int calls = 1000000;
+
+    {
+        lua_State* L = luaL_newstate();
+        if(!initState(L))
+        {
+            return 1;
+        }
+        double seconds = runTicks(L, calls, putUnit);
+        std::cout << "[C++] default allocator : " << (seconds * 1e9 / calls) << " ns/call" << std::endl;
+        std::cout << "[C++]   lua memory in use : " << (lua_gc(L, LUA_GCCOUNT, 0) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0)) << " bytes" << std::endl;
+        lua_close(L);
+    }
+
+    runWithPool("pool allocator", calls, putUnit);
+    runWithPool("pool allocator + userdata cache", calls, putUnitCached);
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <lua.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bytecodecache.hpp"
+
+/**
+ * Startup time of loading a lot of scripts:
+ *  - luaL_loadfile, which parses every script every time.
+ *  - bytecodecache::loadfile with an empty cache (cold), which parses and writes the cache.
+ *  - bytecodecache::loadfile again (warm), which only reads the bytecode back.
+ */
+
+static const int SCRIPT_COUNT = 500;
+static const int FUNCTIONS_PER_SCRIPT = 40;
+static const std::string SCRIPT_DIR = "scripts";
+static const std::string CACHE_DIR = ".luacache";
+
+/**
+ * Write a directory of generated scripts, each with a few functions like the ones in the other examples.
+ */
+std::vector<std::string> generateScripts()
+{
+    mkdir(SCRIPT_DIR.c_str(), 0755);
+    std::vector<std::string> filenames;
+    for(int s = 0; s < SCRIPT_COUNT; s++)
+    {
+        std::string filename = SCRIPT_DIR + "/script" + std::to_string(s) + ".lua";
+        std::ofstream out(filename.c_str());
+        for(int f = 0; f < FUNCTIONS_PER_SCRIPT; f++)
+        {
+            out << "function damage_" << s << "_" << f << "(x, y)\n";
+            out << "    local total = 0\n";
+            out << "    for i = 1, x do\n";
+            out << "        if i % 2 == 0 then total = total + i * " << f << " else total = total - y end\n";
+            out << "    end\n";
+            out << "    return total, x + y, \"script" << s << "\"\n";
+            out << "end\n\n";
+        }
+        filenames.push_back(filename);
+    }
+    return filenames;
+}
+
+void clearCache()
+{
+    DIR* dir = opendir(CACHE_DIR.c_str());
+    if(!dir)
+    {
+        return;
+    }
+    while(dirent* entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if(name != "." && name != "..")
+        {
+            unlink((CACHE_DIR + "/" + name).c_str());
+        }
+    }
+    closedir(dir);
+}
+
+/**
+ * Load every script into a new state and run it, returns the time in milliseconds.
+ */
+template <typename Loader>
+double loadAll(const std::vector<std::string>& filenames, Loader loader)
+{
+    lua_State* L = luaL_newstate();
+    luaL_requiref(L, "base", luaopen_base, 1);
+    lua_settop(L, 0);
+    auto start = std::chrono::steady_clock::now();
+    for(auto& filename : filenames)
+    {
+        if(loader(L, filename) != LUA_OK || lua_pcall(L, 0, 0, 0) != LUA_OK)
+        {
+            std::cout << "[C++] error loading " << filename << std::endl;
+            lua_settop(L, 0);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    lua_close(L);
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> filenames = generateScripts();
+    clearCache();
+
+    double plain = loadAll(filenames, [](lua_State* L, const std::string& filename) { return luaL_loadfile(L, filename.c_str()); });
+    double cold = loadAll(filenames, [](lua_State* L, const std::string& filename) { return bytecodecache::loadfile(L, filename, CACHE_DIR); });
+    double warm = loadAll(filenames, [](lua_State* L, const std::string& filename) { return bytecodecache::loadfile(L, filename, CACHE_DIR); });
+
+    std::cout << "[C++] " << filenames.size() << " scripts" << std::endl;
+    std::cout << "[C++] luaL_loadfile      : " << plain << " ms" << std::endl;
+    std::cout << "[C++] cache, cold start  : " << cold << " ms" << std::endl;
+    std::cout << "[C++] cache, warm start  : " << warm << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,13 @@
+-- edit this file while the example is running, the new functions are used on the next tick.
+function snake_damage_func(x)
+    return x + 2;
+end
+
+function bear_damage_func(x)
+    return x * 2;
+end
+
+function applyDamage(attacker, target)
+    local damage = attacker:getDamage();
+    target:dealtDamage(damage);
+end
@@ -0,0 +1,220 @@
+#include <lua.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "callbudget.hpp"
+#include "functionhandle.hpp"
+#include "scriptreloader.hpp"
+
+/**
+ * Parts 3 and 5 put together in a game loop.
+ * While this is running, change function.lua and save it: the next tick uses the new functions
+ * without restarting and without creating a new lua_State.
+ * A function that now fails (e.g. return x + nil) or never returns only loses its tick.
+ */
+
+/**
+ * Print and pop the error of a call that did not succeed. Returns true if it did.
+ */
+bool report(lua_State* L, const std::string& name, callbudget::Status status)
+{
+    if(status == callbudget::OK)
+    {
+        return true;
+    }
+    std::cout << "[C++] " << name << (status == callbudget::TIMEOUT ? " timed out : " : " failed : ") << lua_tostring(L, -1) << std::endl;
+    lua_pop(L, 1);
+    return false;
+}
+
+class DamageFunction
+{
+public:
+    DamageFunction(lua_State* state, const std::string& functionname)
+        : L(state), name(functionname), function(state, functionname), budget(0, 50)
+    {
+    }
+    lua_State* L;
+    std::string name;
+    FunctionHandle function;
+    // a live edit may loop forever
+    callbudget::Budget budget;
+
+    /**
+     * Get the damage based on hero's strength.
+     * Returns -1 if the function fails or runs out of budget.
+     */
+    int getDamage(const int& str)
+    {
+        if(function.push())
+        {
+            lua_pushnumber(L, str);
+            if(!report(L, name, callbudget::pcall(L, 1, 1, budget)))
+            {
+                return -1;
+            }
+            int damageValue = (int) lua_tointeger(L, -1);
+            lua_pop(L, 1);
+            return damageValue;
+        }
+        else
+        {
+            std::cout << "Cannot find " << name << " function" << std::endl;
+            return -1;
+        }
+    }
+};
+
+class Unit 
+{
+public:
+    Unit(const int& d = 1, const int& h = 20)
+        : damage(d), health(h)
+    {
+    }
+    int damage;
+    int health;
+
+    void dealtDamage(const int& damage)
+    {
+        health -= damage;
+        health = health < 0 ? 0 : health;
+    }
+
+    int getDamage() 
+    {
+        return damage;
+    }
+};
+
+void putUnit(lua_State* L, Unit& unit)
+{
+    Unit** userdata = static_cast<Unit**>(lua_newuserdata(L, sizeof(Unit*)));
+    *userdata = &unit;
+    luaL_setmetatable(L, "UnitMT");
+}
+
+class ApplyDamageFunction
+{
+public:
+    ApplyDamageFunction(lua_State* state, const std::string& functionname)
+        : L(state), function(state, functionname), budget(0, 50)
+    {
+    }
+    lua_State* L;
+    FunctionHandle function;
+    callbudget::Budget budget;
+
+    void applyDamage(Unit& attacker, Unit& defender)
+    {
+        if(function.push())
+        {
+            putUnit(L, attacker);
+            putUnit(L, defender);
+            report(L, function.getName(), callbudget::pcall(L, 2, 0, budget));
+        }
+        else
+        {
+            std::cout << "Cannot find " << function.getName() << "function" << std::endl;
+        }
+    }
+};
+
+extern "C"
+{
+    static int function_unit_getDamage(lua_State* L)
+    {
+        Unit** unit = static_cast<Unit**>(luaL_checkudata(L, 1, "UnitMT"));
+        lua_pushnumber(L, (**unit).getDamage());
+        return 1;
+    }
+
+    static int function_unit_dealtDamage(lua_State* L)
+    {
+        Unit** unit = static_cast<Unit**>(luaL_checkudata(L, 1, "UnitMT"));
+        int damage = luaL_checkint(L, 2);
+        (**unit).dealtDamage(damage);
+        return 0;
+    }
+}
+
+void loadWrapper(lua_State* L)
+{
+    luaL_newmetatable(L, "UnitMT");
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, function_unit_getDamage);
+    lua_setfield(L, -2, "getDamage");
+    lua_pushcfunction(L, function_unit_dealtDamage);
+    lua_setfield(L, -2, "dealtDamage");
+    lua_pop(L, 1);
+}
+
+void gameLoop(lua_State* L, int seconds)
+{
+    ScriptReloader reloader(L);
+    reloader.watch("function.lua");
+    if(!reloader.start())
+    {
+        std::cout << "[C++] could not watch function.lua, hot reload disabled" << std::endl;
+    }
+
+    DamageFunction snake(L, "snake_damage_func");
+    DamageFunction bear(L, "bear_damage_func");
+    ApplyDamageFunction applyDamage(L, "applyDamage");
+
+    const int ticksPerSecond = 10;
+    for(int tick = 0; tick < seconds * ticksPerSecond; tick++)
+    {
+        // between ticks, swap in whatever was recompiled.
+        reloader.update();
+
+        Unit attacker(snake.getDamage(5), 100);
+        Unit defender(1, 100);
+        applyDamage.applyDamage(attacker, defender);
+
+        if(tick % ticksPerSecond == 0)
+        {
+            std::cout << "[C++] tick " << tick << " : snake(5) = " << snake.getDamage(5) << ", bear(5) = " << bear.getDamage(5)
+                      << ", defender health after hit = " << defender.health << std::endl;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000 / ticksPerSecond));
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 30;
+
+    // create a new Lua state.
+    lua_State* L = luaL_newstate();
+
+    // load Lua libraries
+    std::vector<luaL_Reg> lualibs =
+        { {"base", luaopen_base} ,
+          {"io", luaopen_io} };
+    for(auto& it : lualibs)
+    {
+        // load the required lua libs and store it in the global space.
+        luaL_requiref(L, it.name, it.func, 1);
+        // clear the stack in case there is some remaining stuffs there.
+        lua_settop(L, 0);
+    }
+
+    // load the script
+    if(luaL_loadfile(L, "function.lua") != LUA_OK || lua_pcall(L, 0, LUA_MULTRET, 0) != LUA_OK)
+    {
+        std::cout << "[C++] error loading script" << std::endl;
+        return 1;
+    }
+    std::cout << "[C++] script loaded, edit function.lua to see it reloaded" << std::endl;
+    loadWrapper(L);
+
+    gameLoop(L, seconds);
+
+    lua_close(L);
+    return 0;
+}
@@ -0,0 +1,179 @@
+#ifndef COMMON_BINDER_HPP
+#define COMMON_BINDER_HPP
+#include <lua.hpp>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+/**
+ * Generate the lua_CFunction wrapper of a member function at compile time.
+ *
+ * Instead of writing a function_unit_dealtDamage by hand (get self, check the arguments,
+ * call, push the result), the wrapper is a template instantiated for the member function pointer,
+ * so everything is known at compile time and the compiler inlines it into the same code.
+ *
+ *     template <> struct binder::Self<Unit> { static Unit* get(lua_State* L, int index) { ... } };
+ *
+ *     const luaL_Reg methods[] = {
+ *         LUA_BIND("getDamage", &Unit::getDamage),
+ *         LUA_BIND("dealtDamage", &Unit::dealtDamage),
+ *         { 0, 0 }
+ *     };
+ *     luaL_setfuncs(L, methods, 0);
+ *
+ * Self<C> has to be specialized for every class, it returns the object at index
+ * or raises a lua error.
+ *
+ * A lua error longjmps over C++ destructors, so the arguments are read in two steps: check reads
+ * every one of them, in order, into a plain value (e.g. the const char* and length of a string),
+ * and only when all of them are fine does convert make the C++ values (e.g. the std::string).
+ */
+namespace binder
+{
+    template <typename C>
+    struct Self;
+
+    /**
+     * Converting a value from and to lua. Specialize for more types.
+     * Raw must be trivially destructible, check may raise a lua error and convert must not.
+     */
+    template <typename T, typename Enable = void>
+    struct Value;
+
+    template <typename T>
+    struct Value<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type>
+    {
+        typedef T Raw;
+        static Raw check(lua_State* L, int index) { return (T) luaL_checkinteger(L, index); }
+        static T convert(Raw raw) { return raw; }
+        static void push(lua_State* L, T value) { lua_pushinteger(L, (lua_Integer) value); }
+    };
+
+    template <typename T>
+    struct Value<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+    {
+        typedef T Raw;
+        static Raw check(lua_State* L, int index) { return (T) luaL_checknumber(L, index); }
+        static T convert(Raw raw) { return raw; }
+        static void push(lua_State* L, T value) { lua_pushnumber(L, (lua_Number) value); }
+    };
+
+    template <>
+    struct Value<bool>
+    {
+        typedef bool Raw;
+        static Raw check(lua_State* L, int index) { return lua_toboolean(L, index) != 0; }
+        static bool convert(Raw raw) { return raw; }
+        static void push(lua_State* L, bool value) { lua_pushboolean(L, value); }
+    };
+
+    template <>
+    struct Value<std::string>
+    {
+        // the string stays on the lua stack, so the pointer is valid for the whole call
+        struct Raw
+        {
+            const char* s;
+            size_t length;
+        };
+        static Raw check(lua_State* L, int index)
+        {
+            Raw raw;
+            raw.s = luaL_checklstring(L, index, &raw.length);
+            return raw;
+        }
+        static std::string convert(Raw raw) { return std::string(raw.s, raw.length); }
+        static void push(lua_State* L, const std::string& value) { lua_pushlstring(L, value.data(), value.size()); }
+    };
+
+    // const int& and friends are converted as int.
+    template <typename T>
+    struct Arg
+    {
+        typedef typename std::remove_cv<typename std::remove_reference<T>::type>::type type;
+    };
+
+    // index_sequence is c++14, so we have our own.
+    template <int... I>
+    struct Indices
+    {
+    };
+
+    template <int N, int... I>
+    struct MakeIndices : MakeIndices<N - 1, N - 1, I...>
+    {
+    };
+
+    template <int... I>
+    struct MakeIndices<0, I...>
+    {
+        typedef Indices<I...> type;
+    };
+
+    /**
+     * Call self->*f with the arguments from the lua stack. Argument n is at index n + 2, after self.
+     * The braces evaluate the checks left to right, before any argument is converted.
+     */
+    template <typename R, typename C, typename F, typename... Args>
+    struct Invoke
+    {
+        template <int... I>
+        static int call(lua_State* L, C* self, F f, Indices<I...>)
+        {
+            std::tuple<typename Value<typename Arg<Args>::type>::Raw...> raw { Value<typename Arg<Args>::type>::check(L, I + 2)... };
+            Value<typename Arg<R>::type>::push(L, (self->*f)(Value<typename Arg<Args>::type>::convert(std::get<I>(raw))...));
+            return 1;
+        }
+    };
+
+    template <typename C, typename F, typename... Args>
+    struct Invoke<void, C, F, Args...>
+    {
+        template <int... I>
+        static int call(lua_State* L, C* self, F f, Indices<I...>)
+        {
+            std::tuple<typename Value<typename Arg<Args>::type>::Raw...> raw { Value<typename Arg<Args>::type>::check(L, I + 2)... };
+            (self->*f)(Value<typename Arg<Args>::type>::convert(std::get<I>(raw))...);
+            // L is not used by a method without arguments
+            (void) L;
+            return 0;
+        }
+    };
+
+    template <typename F, F f>
+    struct Method;
+
+    template <typename C, typename R, typename... Args, R (C::*f)(Args...)>
+    struct Method<R (C::*)(Args...), f>
+    {
+        static int call(lua_State* L)
+        {
+            C* self = Self<C>::get(L, 1);
+            return Invoke<R, C, R (C::*)(Args...), Args...>::call(L, self, f, typename MakeIndices<sizeof...(Args)>::type());
+        }
+    };
+
+    template <typename C, typename R, typename... Args, R (C::*f)(Args...) const>
+    struct Method<R (C::*)(Args...) const, f>
+    {
+        static int call(lua_State* L)
+        {
+            C* self = Self<C>::get(L, 1);
+            return Invoke<R, C, R (C::*)(Args...) const, Args...>::call(L, self, f, typename MakeIndices<sizeof...(Args)>::type());
+        }
+    };
+
+    template <typename F, F f>
+    luaL_Reg bind(const char* name)
+    {
+        luaL_Reg reg = { name, &Method<F, f>::call };
+        return reg;
+    }
+}
+
+/**
+ * c++11 can't deduce the type of a non type template parameter, so this fills it in.
+ */
+#define LUA_BIND(name, method) binder::bind<decltype(method), method>(name)
+
+#endif
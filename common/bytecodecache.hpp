@@ -0,0 +1,207 @@
+#ifndef COMMON_BYTECODECACHE_HPP
+#define COMMON_BYTECODECACHE_HPP
+#include <lua.hpp>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * A drop-in replacement for luaL_loadfile that keeps the compiled chunk around.
+ *
+ * The first time a script is loaded, it is compiled as usual and the bytecode is written
+ * (with lua_dump) to <cacheDir>/<hash of the path>.luac together with the size and content hash
+ * of the source. The next time, if the source hasn't changed, the bytecode is mmapped and given
+ * to lua_load directly so the script is not parsed again. The source is still read and hashed
+ * every time (the mtime can't tell apart two saves in the same second), which is cheap next to parsing.
+ *
+ * Like luaL_loadfile, on success the chunk is left on the stack and LUA_OK is returned.
+ * Files luaL_loadfile treats specially (a "#" first line, a UTF-8 BOM, a precompiled chunk)
+ * are left to it and not cached.
+ */
+namespace bytecodecache
+{
+    static const char MAGIC[8] = { 'L', 'U', 'A', 'C', 'A', 'C', 'H', '2' };
+
+    struct Header
+    {
+        char magic[8];
+        long long size;
+        unsigned long long hash;
+    };
+
+    /**
+     * FNV-1a, good enough to tell if a file changed.
+     */
+    inline unsigned long long hash(const char* data, size_t size, unsigned long long h = 14695981039346656037ULL)
+    {
+        for(size_t i = 0; i < size; i++)
+        {
+            h ^= (unsigned char) data[i];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    inline bool readFile(const std::string& filename, std::vector<char>& content)
+    {
+        FILE* file = fopen(filename.c_str(), "rb");
+        if(!file)
+        {
+            return false;
+        }
+        content.clear();
+        char buffer[4096];
+        size_t read;
+        while((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        {
+            content.insert(content.end(), buffer, buffer + read);
+        }
+        fclose(file);
+        return true;
+    }
+
+    inline std::string cachePath(const std::string& cacheDir, const std::string& filename)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.luac", hash(filename.c_str(), filename.size()));
+        return cacheDir + "/" + name;
+    }
+
+    struct Buffer
+    {
+        const char* data;
+        size_t size;
+    };
+
+    // lua_Reader that hands the whole buffer to lua in one piece.
+    inline const char* readBuffer(lua_State* L, void* ud, size_t* size)
+    {
+        Buffer* buffer = static_cast<Buffer*>(ud);
+        if(buffer->size == 0)
+        {
+            return 0;
+        }
+        *size = buffer->size;
+        buffer->size = 0;
+        return buffer->data;
+    }
+
+    // lua_Writer that appends the bytecode to a vector.
+    inline int writeBuffer(lua_State* L, const void* p, size_t size, void* ud)
+    {
+        std::vector<char>* out = static_cast<std::vector<char>*>(ud);
+        out->insert(out->end(), static_cast<const char*>(p), static_cast<const char*>(p) + size);
+        return 0;
+    }
+
+    /**
+     * Load the bytecode from the cache file, if its header matches the source content.
+     */
+    inline bool loadFromCache(lua_State* L, const std::string& path, const std::string& chunkname, const std::vector<char>& content)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+        {
+            return false;
+        }
+        struct stat cached;
+        if(fstat(fd, &cached) != 0 || (size_t) cached.st_size <= sizeof(Header))
+        {
+            close(fd);
+            return false;
+        }
+        size_t size = cached.st_size;
+        void* mapped = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(mapped == MAP_FAILED)
+        {
+            return false;
+        }
+        const char* data = static_cast<const char*>(mapped);
+        Header header;
+        memcpy(&header, data, sizeof(Header));
+        bool valid = memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.size == (long long) content.size()
+            && header.hash == hash(content.data(), content.size());
+        if(valid)
+        {
+            Buffer buffer = { data + sizeof(Header), size - sizeof(Header) };
+            // only accept binary chunks from the cache.
+            valid = lua_load(L, readBuffer, &buffer, chunkname.c_str(), "b") == LUA_OK;
+            if(!valid)
+            {
+                lua_pop(L, 1);
+            }
+        }
+        munmap(mapped, size);
+        return valid;
+    }
+
+    inline void writeCache(lua_State* L, const std::string& path, const std::vector<char>& content)
+    {
+        std::vector<char> out(sizeof(Header));
+#if LUA_VERSION_NUM >= 503
+        if(lua_dump(L, writeBuffer, &out, 0) != 0)
+#else
+        if(lua_dump(L, writeBuffer, &out) != 0)
+#endif
+        {
+            return;
+        }
+        Header header;
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.size = (long long) content.size();
+        header.hash = hash(content.data(), content.size());
+        memcpy(out.data(), &header, sizeof(Header));
+
+        // write to a temporary file and rename it, so another process never reads half a file.
+        std::string temp = path + ".tmp";
+        FILE* file = fopen(temp.c_str(), "wb");
+        if(!file)
+        {
+            return;
+        }
+        bool written = fwrite(out.data(), 1, out.size(), file) == out.size();
+        fclose(file);
+        if(!written || rename(temp.c_str(), path.c_str()) != 0)
+        {
+            remove(temp.c_str());
+        }
+    }
+
+    /**
+     * Load a script, using the cached bytecode when it is up to date.
+     */
+    inline int loadfile(lua_State* L, const std::string& filename, const std::string& cacheDir = ".luacache")
+    {
+        std::vector<char> content;
+        // a file that can't be read : let lua report the error the usual way.
+        // luaL_loadfile skips a "#" first line and a UTF-8 BOM and loads precompiled chunks, leave those to it.
+        if(!readFile(filename, content)
+            || (!content.empty() && (content[0] == '#' || content[0] == LUA_SIGNATURE[0]))
+            || (content.size() >= 3 && memcmp(content.data(), "\xEF\xBB\xBF", 3) == 0))
+        {
+            return luaL_loadfile(L, filename.c_str());
+        }
+        std::string chunkname = "@" + filename;
+        std::string path = cachePath(cacheDir, filename);
+        if(loadFromCache(L, path, chunkname, content))
+        {
+            return LUA_OK;
+        }
+
+        int status = luaL_loadbufferx(L, content.data(), content.size(), chunkname.c_str(), "t");
+        if(status == LUA_OK)
+        {
+            mkdir(cacheDir.c_str(), 0755);
+            writeCache(L, path, content);
+        }
+        return status;
+    }
+}
+
+#endif
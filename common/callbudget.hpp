@@ -0,0 +1,217 @@
+#ifndef COMMON_CALLBUDGET_HPP
+#define COMMON_CALLBUDGET_HPP
+#include <lua.hpp>
+#include <chrono>
+
+/**
+ * Limit how long a single call into lua can run.
+ *
+ * A count hook fires every CHECK_PERIOD instructions while the call runs. Each time it adds up the
+ * instructions and looks at the clock, and when either the instruction budget or the deadline
+ * is exceeded it raises an error. The call is a lua_pcall, so the error unwinds back to us and
+ * the state can be used again afterwards.
+ *
+ * A pcall in the script could catch that error and carry on, so once the budget has run out the
+ * hook fires on every instruction and raises the error again, until the call has unwound.
+ *
+ * The hook the state had before (e.g. the Profiler) keeps getting its events during the call:
+ * the budget's hook passes them on, the count events every count of that hook.
+ */
+namespace callbudget
+{
+    enum Status
+    {
+        OK,
+        ERROR,   // the function raised an error, the message is on the stack
+        TIMEOUT, // the budget ran out, the message is on the stack
+    };
+
+    struct Budget
+    {
+        Budget(long long instructions = 0, double milliseconds = 0)
+            : maxInstructions(instructions), maxMilliseconds(milliseconds)
+        {
+        }
+        // 0 means no limit
+        long long maxInstructions;
+        double maxMilliseconds;
+
+        bool isLimited() const
+        {
+            return maxInstructions > 0 || maxMilliseconds > 0;
+        }
+    };
+
+    static const int CHECK_PERIOD = 1000;
+
+    struct Running
+    {
+        typedef std::chrono::steady_clock Clock;
+        const Budget* budget;
+        long long executed;
+        Clock::time_point deadline;
+        bool expired;
+        // the count the hook is set with, and the instructions left until the next check
+        int step;
+        int untilCheck;
+        // the hook in place before the call, it gets the events passed on
+        lua_Hook previousHook;
+        int previousMask;
+        int previousCount;
+        int untilPrevious;
+        // the budget of the call this one is nested in, if any
+        Running* previous;
+    };
+
+    // the address of this is the key of the running budget in the registry.
+    inline const void* registryKey()
+    {
+        static const char key = 0;
+        return &key;
+    }
+
+    inline void hook(lua_State* L, lua_Debug* ar);
+
+    /**
+     * From now on every instruction raises the error, so a pcall in the script can't keep going.
+     */
+    inline void expire(lua_State* L, Running* running)
+    {
+        running->expired = true;
+        lua_sethook(L, hook, LUA_MASKCOUNT, 1);
+    }
+
+    // the hook event ar of the call running, then of the hook before it
+    inline void dispatch(lua_State* L, lua_Debug* ar, Running* running)
+    {
+        bool forward = true;
+        if(ar->event == LUA_HOOKCOUNT)
+        {
+            if(running->expired)
+            {
+                luaL_error(L, "budget exceeded");
+            }
+            running->executed += running->step;
+            running->untilCheck -= running->step;
+            if(running->untilCheck <= 0)
+            {
+                running->untilCheck += CHECK_PERIOD;
+                const Budget& budget = *running->budget;
+                if(budget.maxInstructions > 0 && running->executed > budget.maxInstructions)
+                {
+                    expire(L, running);
+                    // as a number, %d would cut budgets above INT_MAX
+                    luaL_error(L, "instruction budget of %f exceeded", (lua_Number) budget.maxInstructions);
+                }
+                if(budget.maxMilliseconds > 0 && Running::Clock::now() > running->deadline)
+                {
+                    expire(L, running);
+                    luaL_error(L, "deadline of %f ms exceeded", budget.maxMilliseconds);
+                }
+            }
+            // the previous hook gets a count event every previousCount instructions, as before
+            forward = (running->previousMask & LUA_MASKCOUNT) != 0;
+            if(forward)
+            {
+                running->untilPrevious -= running->step;
+                forward = running->untilPrevious <= 0;
+                if(forward)
+                {
+                    running->untilPrevious += running->previousCount;
+                }
+            }
+        }
+        // the other events are only asked for when the previous hook wants them
+        if(!forward || !running->previousHook)
+        {
+            return;
+        }
+        if(running->previousHook == hook)
+        {
+            // the budget of an outer call, it goes on counting
+            if(running->previous)
+            {
+                dispatch(L, ar, running->previous);
+            }
+            return;
+        }
+        running->previousHook(L, ar);
+    }
+
+    inline void hook(lua_State* L, lua_Debug* ar)
+    {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, registryKey());
+        Running* running = static_cast<Running*>(lua_touserdata(L, -1));
+        lua_pop(L, 1);
+        if(running)
+        {
+            dispatch(L, ar, running);
+        }
+    }
+
+    /**
+     * Like lua_pcall, but gives up when the budget runs out.
+     * On ERROR and TIMEOUT the message is left on the stack instead of the results.
+     */
+    inline Status pcall(lua_State* L, int nargs, int nresults, const Budget& budget)
+    {
+        if(!budget.isLimited())
+        {
+            return lua_pcall(L, nargs, nresults, 0) == LUA_OK ? OK : ERROR;
+        }
+        Running running;
+        running.budget = &budget;
+        running.executed = 0;
+        running.expired = false;
+        if(budget.maxMilliseconds > 0)
+        {
+            running.deadline = Running::Clock::now()
+                + std::chrono::duration_cast<Running::Clock::duration>(std::chrono::duration<double, std::milli>(budget.maxMilliseconds));
+        }
+
+        // keep the previous hook and budget, calls can be nested.
+        lua_Hook previousHook = lua_gethook(L);
+        int previousMask = previousHook ? lua_gethookmask(L) : 0;
+        int previousCount = lua_gethookcount(L);
+        lua_rawgetp(L, LUA_REGISTRYINDEX, registryKey());
+        Running* previousRunning = static_cast<Running*>(lua_touserdata(L, -1));
+        lua_pop(L, 1);
+        running.previousHook = previousHook;
+        running.previousMask = previousMask;
+        running.previousCount = previousCount > 0 ? previousCount : 1;
+        running.untilPrevious = running.previousCount;
+        running.previous = previousHook == hook ? previousRunning : 0;
+        // count often enough for both hooks
+        running.step = CHECK_PERIOD;
+        if((previousMask & LUA_MASKCOUNT) && running.previousCount < running.step)
+        {
+            running.step = running.previousCount;
+        }
+        running.untilCheck = CHECK_PERIOD;
+
+        lua_pushlightuserdata(L, &running);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, registryKey());
+        lua_sethook(L, hook, LUA_MASKCOUNT | (previousMask & ~LUA_MASKCOUNT), running.step);
+
+        int result = lua_pcall(L, nargs, nresults, 0);
+
+        lua_sethook(L, previousHook, previousMask, previousCount);
+        if(previousRunning)
+        {
+            lua_pushlightuserdata(L, previousRunning);
+        }
+        else
+        {
+            lua_pushnil(L);
+        }
+        lua_rawsetp(L, LUA_REGISTRYINDEX, registryKey());
+
+        if(result == LUA_OK)
+        {
+            return OK;
+        }
+        return running.expired ? TIMEOUT : ERROR;
+    }
+}
+
+#endif
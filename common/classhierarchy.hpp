@@ -0,0 +1,239 @@
+#ifndef COMMON_CLASSHIERARCHY_HPP
+#define COMMON_CLASSHIERARCHY_HPP
+#include <lua.hpp>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "userdatacache.hpp"
+
+/**
+ * Type checks for a C++ class hierarchy exposed to lua, without going through the registry.
+ *
+ * luaL_testudata looks up the metatable by name and compares it, so a method shared by
+ * Unit and Character has to do it once per class. Instead, every class gets a small tag when
+ * it is registered, together with the set of classes it derives from. The userdata stores the
+ * tag next to the pointer, so checking "is this a Unit (or anything derived from it)" is
+ * reading the userdata and testing one bit, however deep the hierarchy is.
+ *
+ * The pointer stored is always the Root pointer, so the wrappers can use it directly for
+ * any method of Root. Only single, non virtual inheritance is supported, and at most 64 classes.
+ *
+ * push only stores a pointer to an object that C++ owns. create makes an object owned by lua
+ * instead: it is constructed inside the userdata, right after the Box, so it is one allocation
+ * and the object is next to the pointer to it. The __gc set by install runs its destructor.
+ *
+ * A userdata is only taken as ours if its size is that of a Box (or of the object made by create),
+ * its metatable is the one of the class in the Box and the Box has the magic number.
+ * install marks the metatables with their tag for that, so the check is a raw get and no name lookup.
+ */
+template <typename Root>
+class ClassHierarchy
+{
+public:
+    typedef unsigned short Tag;
+    static const Tag NONE = 0xffff;
+
+    /**
+     * What is stored in the userdata. The object pointer comes first, so userdatacache::invalidate works on it.
+     */
+    struct Box
+    {
+        Root* object;
+        unsigned magic;
+        Tag tag;
+        // only for the objects owned by lua, null for the ones pushed with push
+        void (*destroy)(Root*);
+    };
+
+    /**
+     * Register a class, with the name of its metatable and the tag of its parent class.
+     * Returns the tag of the new class, or NONE if there are already 64 classes.
+     */
+    Tag add(const std::string& metatable, Tag parent = NONE)
+    {
+        if(classes.size() >= 64)
+        {
+            return NONE;
+        }
+        Tag tag = (Tag) classes.size();
+        Class c;
+        c.metatable = metatable;
+        c.ancestors = 1ULL << tag;
+        c.ownedSize = 0;
+        if(parent != NONE)
+        {
+            c.ancestors |= classes[parent].ancestors;
+        }
+        classes.push_back(c);
+        return tag;
+    }
+
+    const std::string& metatableOf(Tag tag) const
+    {
+        return classes[tag].metatable;
+    }
+
+    /**
+     * Push the userdata for object, which is of the class tag.
+     * The same object always gets the same userdata (see userdatacache).
+     */
+    void push(lua_State* L, Root* object, Tag tag)
+    {
+        const char* metatable = classes[tag].metatable.c_str();
+        if(userdatacache::pushCached(L, object, metatable))
+        {
+            return;
+        }
+        Box* box = static_cast<Box*>(lua_newuserdata(L, sizeof(Box)));
+        box->object = object;
+        box->magic = MAGIC;
+        box->tag = tag;
+        box->destroy = 0;
+        luaL_setmetatable(L, metatable);
+        userdatacache::store(L, object, metatable);
+    }
+
+    /**
+     * Construct a T (Root or derived from it, of the class tag) inside a new userdata and push it.
+     * Lua owns it, it is destroyed when the userdata is collected. install must have been called.
+     * The arguments are used after lua_newuserdata, which can raise a lua error : don't pass
+     * anything that needs a destructor (e.g. a std::string made for the call).
+     */
+    template <typename T, typename... Args>
+    T* create(lua_State* L, Tag tag, Args&&... args)
+    {
+        classes[tag].ownedSize = sizeof(Owned<T>);
+        Owned<T>* owned = static_cast<Owned<T>*>(lua_newuserdata(L, sizeof(Owned<T>)));
+        T* object = new (&owned->storage) T(std::forward<Args>(args)...);
+        owned->box.object = object;
+        owned->box.magic = MAGIC;
+        owned->box.tag = tag;
+        owned->box.destroy = destroyObject<T>;
+        luaL_setmetatable(L, classes[tag].metatable.c_str());
+        return object;
+    }
+
+    /**
+     * Mark the metatable of every class with its tag, and add the __gc of the owned objects.
+     * Call it once the metatables are made and before any push or create,
+     * lua only runs the __gc of userdata created after it is set.
+     */
+    void install(lua_State* L)
+    {
+        for(size_t tag = 0; tag < classes.size(); tag++)
+        {
+            luaL_getmetatable(L, classes[tag].metatable.c_str());
+            if(lua_istable(L, -1))
+            {
+                lua_pushinteger(L, (lua_Integer) tag);
+                lua_rawsetp(L, -2, this);
+                lua_pushcfunction(L, collect);
+                lua_setfield(L, -2, "__gc");
+            }
+            lua_pop(L, 1);
+        }
+    }
+
+    /**
+     * The tag of the userdata at index, or NONE if it is not one of ours.
+     */
+    Tag tagOf(lua_State* L, int index) const
+    {
+        const Box* box = toBox(L, index);
+        return box ? box->tag : NONE;
+    }
+
+    /**
+     * The object at index if it is of class tag or derived from it, else null.
+     * Null is also returned for an object that has been invalidated.
+     */
+    Root* test(lua_State* L, int index, Tag tag) const
+    {
+        const Box* box = toBox(L, index);
+        if(box && (classes[box->tag].ancestors & (1ULL << tag)))
+        {
+            return box->object;
+        }
+        return 0;
+    }
+
+private:
+    static const unsigned MAGIC = 0x43485459;
+
+    struct Class
+    {
+        std::string metatable;
+        // bit n is set if the class is, or derives from, the class with tag n.
+        unsigned long long ancestors;
+        // the size of the userdata made by create, 0 if it has never been used.
+        size_t ownedSize;
+    };
+
+    std::vector<Class> classes;
+
+    template <typename T>
+    struct Owned
+    {
+        Box box;
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+    };
+
+    template <typename T>
+    static void destroyObject(Root* object)
+    {
+        static_cast<T*>(object)->~T();
+    }
+
+    // __gc of every class
+    static int collect(lua_State* L)
+    {
+        if(lua_rawlen(L, 1) < sizeof(Box))
+        {
+            return 0;
+        }
+        Box* box = static_cast<Box*>(lua_touserdata(L, 1));
+        if(box->magic == MAGIC && box->destroy && box->object)
+        {
+            box->destroy(box->object);
+            // in case lua still gets to it (e.g. from another __gc), the methods see a destroyed object.
+            box->object = 0;
+            box->destroy = 0;
+        }
+        return 0;
+    }
+
+    const Box* toBox(lua_State* L, int index) const
+    {
+        // lua_rawlen is the size of the userdata block, so a smaller userdata is never read.
+        size_t size = lua_type(L, index) == LUA_TUSERDATA ? lua_rawlen(L, index) : 0;
+        if(size < sizeof(Box))
+        {
+            return 0;
+        }
+        const Box* box = static_cast<const Box*>(lua_touserdata(L, index));
+        if(box->magic != MAGIC || box->tag >= classes.size())
+        {
+            return 0;
+        }
+        // a pointer is exactly a Box, an owned object is bigger and has its destroy.
+        bool pointer = size == sizeof(Box) && !box->destroy;
+        bool owned = box->destroy && size == classes[box->tag].ownedSize;
+        if(!pointer && !owned)
+        {
+            return 0;
+        }
+        // and it must have the metatable install marked with that tag
+        if(!lua_getmetatable(L, index))
+        {
+            return 0;
+        }
+        lua_rawgetp(L, -1, this);
+        bool marked = lua_type(L, -1) == LUA_TNUMBER && lua_tointeger(L, -1) == (lua_Integer) box->tag;
+        lua_pop(L, 2);
+        return marked ? box : 0;
+    }
+};
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef COMMON_DAMAGEKERNEL_HPP
+#define COMMON_DAMAGEKERNEL_HPP
+
+/**
+ * Unit::dealtDamage for a whole array of health values at once:
+ *     health[i] = max(health[i] - damage, 0)
+ * with one damage for all of them, or one damage each.
+ *
+ * There is a plain loop, and on x86 an SSE2 and an AVX2 version that do 4 and 8 units per
+ * instruction. The AVX2 one is compiled for AVX2 with a target attribute, so the rest of the
+ * program doesn't need -mavx2, and best() only picks it when the cpu has it.
+ * All of them give exactly the same results as the plain loop.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define DAMAGEKERNEL_X86 1
+#include <immintrin.h>
+#else
+#define DAMAGEKERNEL_X86 0
+#endif
+
+namespace damagekernel
+{
+    enum Path
+    {
+        SCALAR,
+        SSE2,
+        AVX2,
+    };
+
+    inline const char* pathName(Path path)
+    {
+        return path == AVX2 ? "avx2" : path == SSE2 ? "sse2" : "scalar";
+    }
+
+    inline bool isSupported(Path path)
+    {
+#if DAMAGEKERNEL_X86
+        if(path == AVX2)
+        {
+            return __builtin_cpu_supports("avx2");
+        }
+        return path == SSE2 ? __builtin_cpu_supports("sse2") : true;
+#else
+        return path == SCALAR;
+#endif
+    }
+
+    /**
+     * The fastest path this cpu can run, found once.
+     */
+    inline Path best()
+    {
+        static const Path path = isSupported(AVX2) ? AVX2 : isSupported(SSE2) ? SSE2 : SCALAR;
+        return path;
+    }
+
+    inline void scalar(int* health, int count, int damage)
+    {
+        for(int i = 0; i < count; i++)
+        {
+            int h = health[i] - damage;
+            health[i] = h < 0 ? 0 : h;
+        }
+    }
+
+    inline void scalar(int* health, int count, const int* damages)
+    {
+        for(int i = 0; i < count; i++)
+        {
+            int h = health[i] - damages[i];
+            health[i] = h < 0 ? 0 : h;
+        }
+    }
+
+#if DAMAGEKERNEL_X86
+    // SSE2 has no signed max, so the negative lanes are masked out : h & (h > 0)
+    inline __m128i clampSSE2(__m128i h)
+    {
+        return _mm_and_si128(h, _mm_cmpgt_epi32(h, _mm_setzero_si128()));
+    }
+
+    __attribute__((target("sse2")))
+    inline void sse2(int* health, int count, int damage)
+    {
+        __m128i d = _mm_set1_epi32(damage);
+        int i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(health + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(health + i), clampSSE2(_mm_sub_epi32(h, d)));
+        }
+        scalar(health + i, count - i, damage);
+    }
+
+    __attribute__((target("sse2")))
+    inline void sse2(int* health, int count, const int* damages)
+    {
+        int i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(health + i));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(damages + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(health + i), clampSSE2(_mm_sub_epi32(h, d)));
+        }
+        scalar(health + i, count - i, damages + i);
+    }
+
+    __attribute__((target("avx2")))
+    inline void avx2(int* health, int count, int damage)
+    {
+        __m256i d = _mm256_set1_epi32(damage);
+        __m256i zero = _mm256_setzero_si256();
+        int i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(health + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(health + i), _mm256_max_epi32(_mm256_sub_epi32(h, d), zero));
+        }
+        scalar(health + i, count - i, damage);
+    }
+
+    __attribute__((target("avx2")))
+    inline void avx2(int* health, int count, const int* damages)
+    {
+        __m256i zero = _mm256_setzero_si256();
+        int i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(health + i));
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(damages + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(health + i), _mm256_max_epi32(_mm256_sub_epi32(h, d), zero));
+        }
+        scalar(health + i, count - i, damages + i);
+    }
+#endif
+
+    /**
+     * health[i] = max(health[i] - damage, 0) for i < count.
+     */
+    inline void dealtDamage(int* health, int count, int damage, Path path = best())
+    {
+#if DAMAGEKERNEL_X86
+        if(path == AVX2)
+        {
+            avx2(health, count, damage);
+            return;
+        }
+        if(path == SSE2)
+        {
+            sse2(health, count, damage);
+            return;
+        }
+#endif
+        scalar(health, count, damage);
+    }
+
+    /**
+     * health[i] = max(health[i] - damages[i], 0) for i < count.
+     */
+    inline void dealtDamage(int* health, int count, const int* damages, Path path = best())
+    {
+#if DAMAGEKERNEL_X86
+        if(path == AVX2)
+        {
+            avx2(health, count, damages);
+            return;
+        }
+        if(path == SSE2)
+        {
+            sse2(health, count, damages);
+            return;
+        }
+#endif
+        scalar(health, count, damages);
+    }
+}
+
+#endif
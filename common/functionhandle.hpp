@@ -0,0 +1,199 @@
+#ifndef COMMON_FUNCTIONHANDLE_HPP
+#define COMMON_FUNCTIONHANDLE_HPP
+#include <lua.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * A handle to a global lua function, or a function in nested tables like "functions.computation.compute".
+ *
+ * Instead of doing lua_getglobal + lua_getfield... + lua_type every time we want to call the function,
+ * the function is looked up once and stored in the registry using luaL_ref.
+ * Pushing the function after that is just a lua_rawgeti on the registry, however deep the path is.
+ *
+ * The path is only followed again after a reload, so replacing one of the tables in it
+ * is seen after the next reload, like replacing the function itself.
+ * When a script is (re)loaded, call FunctionHandle::reloaded(L) and every handle of that
+ * state will look up its function again the next time it is pushed.
+ *
+ * The handle must not outlive the lua_State it was created with.
+ */
+class FunctionHandle
+{
+public:
+    FunctionHandle(lua_State* state, const std::string& functionname)
+        : L(state), name(functionname), path(split(functionname)), ref(LUA_NOREF), resolvedGeneration(0), generation(&generationOf(state))
+    {
+    }
+
+    FunctionHandle(const FunctionHandle& other)
+        : L(other.L), name(other.name), path(other.path), ref(LUA_NOREF), resolvedGeneration(0), generation(other.generation)
+    {
+        copyRef(other);
+    }
+
+    FunctionHandle& operator=(const FunctionHandle& other)
+    {
+        if(this != &other)
+        {
+            release();
+            L = other.L;
+            name = other.name;
+            path = other.path;
+            generation = other.generation;
+            copyRef(other);
+        }
+        return *this;
+    }
+
+    ~FunctionHandle()
+    {
+        release();
+    }
+
+    /**
+     * Put the function on the stack.
+     * Returns false if the global is not a function, in which case nothing is pushed.
+     */
+    bool push()
+    {
+        if(resolvedGeneration != *generation)
+        {
+            resolve();
+        }
+        if(ref == LUA_NOREF)
+        {
+            return false;
+        }
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+        return true;
+    }
+
+    lua_State* state() const
+    {
+        return L;
+    }
+
+    const std::string& getName() const
+    {
+        return name;
+    }
+
+    /**
+     * Changes every time the state is reloaded, for anything else that has to be redone after a reload.
+     */
+    unsigned currentGeneration() const
+    {
+        return *generation;
+    }
+
+    /**
+     * Mark all the handles of this state as stale.
+     * Call this after loading or reloading a script.
+     */
+    static void reloaded(lua_State* L)
+    {
+        ++generationOf(L);
+    }
+
+private:
+    lua_State* L;
+    std::string name;
+    // the name split at the dots, done once.
+    std::vector<std::string> path;
+    int ref;
+    unsigned resolvedGeneration;
+    // points into the generation userdata of the state, which the registry keeps alive as long as the state.
+    const unsigned* generation;
+
+    void resolve()
+    {
+        release();
+        lua_getglobal(L, path[0].c_str());
+        size_t found = 1;
+        for(; found < path.size() && lua_istable(L, -1); found++)
+        {
+            lua_getfield(L, -1, path[found].c_str());
+            // remove the table we just looked in
+            lua_remove(L, -2);
+        }
+        if(found == path.size() && lua_type(L, -1) == LUA_TFUNCTION)
+        {
+            // luaL_ref pops the function from the stack
+            ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        }
+        else
+        {
+            lua_pop(L, 1);
+        }
+        resolvedGeneration = *generation;
+    }
+
+    static std::vector<std::string> split(const std::string& name)
+    {
+        std::vector<std::string> parts;
+        size_t begin = 0;
+        while(true)
+        {
+            size_t dot = name.find('.', begin);
+            parts.push_back(name.substr(begin, dot == std::string::npos ? std::string::npos : dot - begin));
+            if(dot == std::string::npos)
+            {
+                return parts;
+            }
+            begin = dot + 1;
+        }
+    }
+
+    void release()
+    {
+        if(ref != LUA_NOREF)
+        {
+            luaL_unref(L, LUA_REGISTRYINDEX, ref);
+            ref = LUA_NOREF;
+        }
+    }
+
+    void copyRef(const FunctionHandle& other)
+    {
+        if(other.ref != LUA_NOREF)
+        {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, other.ref);
+            ref = luaL_ref(L, LUA_REGISTRYINDEX);
+            resolvedGeneration = other.resolvedGeneration;
+        }
+        else
+        {
+            ref = LUA_NOREF;
+            resolvedGeneration = 0;
+        }
+    }
+
+    // the address of this is used as the registry key of the generation counter.
+    static const void* generationKey()
+    {
+        static const char key = 0;
+        return &key;
+    }
+
+    /**
+     * Generation counter of the state, starts at 1 so a new handle is always stale.
+     * It is a userdata in the registry, so it goes away with the state
+     * and a new state at the same address starts again from 1.
+     */
+    static unsigned& generationOf(lua_State* L)
+    {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, generationKey());
+        unsigned* counter = static_cast<unsigned*>(lua_touserdata(L, -1));
+        lua_pop(L, 1);
+        if(counter == 0)
+        {
+            counter = static_cast<unsigned*>(lua_newuserdata(L, sizeof(unsigned)));
+            *counter = 1;
+            lua_rawsetp(L, LUA_REGISTRYINDEX, generationKey());
+        }
+        return *counter;
+    }
+};
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef COMMON_LAZYLIBS_HPP
+#define COMMON_LAZYLIBS_HPP
+#include <lua.hpp>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+/**
+ * Open the standard libraries only when a script uses them.
+ *
+ * install opens base right away (it is _G itself) and gives _G an __index that opens any of the
+ * other libraries the first time its global is read, e.g. the first string.format opens string.
+ * After that the library is a normal global and costs nothing more, and once every library is
+ * open the __index is taken away, so reading a missing global is a plain table miss again.
+ * Strings get a temporary metatable too, so ("x"):upper() opens the string library as well.
+ *
+ * usage tells which libraries were opened, by which script line and how long it took,
+ * and unused the ones no script has asked for.
+ *
+ * _G must not have a metatable of its own.
+ */
+namespace lazylibs
+{
+    struct Usage
+    {
+        std::string library;
+        // "file:line" of the code that asked for it first.
+        std::string firstUser;
+        double microseconds;
+    };
+
+    struct Library
+    {
+        std::string name;
+        lua_CFunction open;
+    };
+
+    /**
+     * Kept in a userdata owned by the lua_State, so it goes away with it.
+     */
+    struct State
+    {
+        // a handful at most, a scan is faster than a map and makes no string for the key.
+        std::vector<Library> pending;
+        std::vector<Usage> used;
+    };
+
+    // the address of this is the key of the State in the registry.
+    inline const void* registryKey()
+    {
+        static const char key = 0;
+        return &key;
+    }
+
+    inline State* stateOf(lua_State* L)
+    {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, registryKey());
+        State* state = static_cast<State*>(lua_touserdata(L, -1));
+        lua_pop(L, 1);
+        return state;
+    }
+
+    /**
+     * Open the library now and push it. Nothing is pushed if it is not pending.
+     */
+    inline bool open(lua_State* L, const char* name)
+    {
+        State* state = stateOf(L);
+        if(!state)
+        {
+            return false;
+        }
+        auto it = state->pending.begin();
+        while(it != state->pending.end() && it->name != name)
+        {
+            it++;
+        }
+        if(it == state->pending.end())
+        {
+            return false;
+        }
+        Library library = *it;
+        state->pending.erase(it);
+
+        Usage usage;
+        usage.library = library.name;
+        usage.firstUser = "C++";
+        lua_Debug ar;
+        // level 0 is the __index that got us here
+        if(lua_getstack(L, 1, &ar) && lua_getinfo(L, "Sl", &ar) && ar.currentline >= 0)
+        {
+            usage.firstUser = std::string(ar.short_src) + ":" + std::to_string(ar.currentline);
+        }
+        auto start = std::chrono::steady_clock::now();
+        luaL_requiref(L, library.name.c_str(), library.open, 1);
+        usage.microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        state->used.push_back(usage);
+
+        // nothing left to open, _G goes back to a plain table
+        if(state->pending.empty())
+        {
+            lua_pushglobaltable(L);
+            lua_pushnil(L);
+            lua_setmetatable(L, -2);
+            lua_pop(L, 1);
+        }
+        return true;
+    }
+
+    // __index of _G : (table, key)
+    inline int globalIndex(lua_State* L)
+    {
+        if(lua_type(L, 2) == LUA_TSTRING && open(L, lua_tostring(L, 2)))
+        {
+            return 1;
+        }
+        lua_pushnil(L);
+        return 1;
+    }
+
+    // __index of strings until the string library is opened : (string, key)
+    inline int stringIndex(lua_State* L)
+    {
+        // opening string replaces this metatable with the real one
+        if(!open(L, "string"))
+        {
+            lua_getglobal(L, "string");
+        }
+        lua_pushvalue(L, 2);
+        lua_gettable(L, -2);
+        return 1;
+    }
+
+    inline int collect(lua_State* L)
+    {
+        static_cast<State*>(lua_touserdata(L, 1))->~State();
+        return 0;
+    }
+
+    /**
+     * Open base now and the rest of libs when they are first used.
+     */
+    inline void install(lua_State* L, const std::vector<luaL_Reg>& libs)
+    {
+        State* state = new (lua_newuserdata(L, sizeof(State))) State();
+        lua_createtable(L, 0, 1);
+        lua_pushcfunction(L, collect);
+        lua_setfield(L, -2, "__gc");
+        lua_setmetatable(L, -2);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, registryKey());
+
+        for(auto& lib : libs)
+        {
+            std::string name = lib.name;
+            if(name == "base" || name == "_G")
+            {
+                luaL_requiref(L, lib.name, lib.func, 1);
+                lua_pop(L, 1);
+            }
+            else
+            {
+                Library library = { name, lib.func };
+                state->pending.push_back(library);
+            }
+        }
+        if(state->pending.empty())
+        {
+            return;
+        }
+
+        lua_pushglobaltable(L);
+        lua_createtable(L, 0, 1);
+        lua_pushcfunction(L, globalIndex);
+        lua_setfield(L, -2, "__index");
+        lua_setmetatable(L, -2);
+        lua_pop(L, 1);
+
+        bool lazyString = false;
+        for(auto& library : state->pending)
+        {
+            lazyString = lazyString || library.name == "string";
+        }
+        if(lazyString)
+        {
+            lua_pushliteral(L, "");
+            lua_createtable(L, 0, 1);
+            lua_pushcfunction(L, stringIndex);
+            lua_setfield(L, -2, "__index");
+            lua_setmetatable(L, -2);
+            lua_pop(L, 1);
+        }
+    }
+
+    /**
+     * The libraries opened so far, in the order they were opened.
+     */
+    inline std::vector<Usage> usage(lua_State* L)
+    {
+        State* state = stateOf(L);
+        return state ? state->used : std::vector<Usage>();
+    }
+
+    /**
+     * The libraries still waiting to be opened.
+     */
+    inline std::vector<std::string> unused(lua_State* L)
+    {
+        std::vector<std::string> names;
+        State* state = stateOf(L);
+        if(state)
+        {
+            for(auto& library : state->pending)
+            {
+                names.push_back(library.name);
+            }
+        }
+        return names;
+    }
+}
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef COMMON_LUACALL_HPP
+#define COMMON_LUACALL_HPP
+#include <lua.hpp>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include "binder.hpp"
+#include "functionhandle.hpp"
+
+/**
+ * Call a lua function with typed arguments and results.
+ *
+ *     std::tuple<int, int, int> sums;
+ *     if(luacall::call(multiFunction, sums, 1, 3, 5))
+ *     {
+ *         ... std::get<0>(sums) ...
+ *     }
+ *
+ * The number of arguments and results is known at compile time, so it is the same
+ * lua_pushinteger / lua_pcall / lua_tointegerx sequence as written by hand, with nothing
+ * allocated on the way. The arguments are pushed with binder::Value.
+ *
+ * The results can be one value, a std::tuple, or a struct with luacall::Results specialized for it.
+ * call returns false if the function is missing, raises an error, or returns values of the wrong
+ * type, and the results are then only partly set.
+ */
+namespace luacall
+{
+    /**
+     * Read one result without raising a lua error. Specialize for more types.
+     */
+    template <typename T, typename Enable = void>
+    struct Result;
+
+    template <typename T>
+    struct Result<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type>
+    {
+        static bool get(lua_State* L, int index, T& value)
+        {
+            int isnum = 0;
+            value = (T) lua_tointegerx(L, index, &isnum);
+            return isnum != 0;
+        }
+    };
+
+    template <typename T>
+    struct Result<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+    {
+        static bool get(lua_State* L, int index, T& value)
+        {
+            int isnum = 0;
+            value = (T) lua_tonumberx(L, index, &isnum);
+            return isnum != 0;
+        }
+    };
+
+    template <>
+    struct Result<bool>
+    {
+        static bool get(lua_State* L, int index, bool& value)
+        {
+            value = lua_toboolean(L, index) != 0;
+            return true;
+        }
+    };
+
+    template <>
+    struct Result<std::string>
+    {
+        static bool get(lua_State* L, int index, std::string& value)
+        {
+            size_t length;
+            const char* s = lua_tolstring(L, index, &length);
+            if(!s)
+            {
+                return false;
+            }
+            value.assign(s, length);
+            return true;
+        }
+    };
+
+    /**
+     * All the results of a call, from index first. count is the number of lua values.
+     */
+    template <typename R>
+    struct Results
+    {
+        static const int count = 1;
+        static bool get(lua_State* L, int first, R& results)
+        {
+            return Result<R>::get(L, first, results);
+        }
+    };
+
+    template <typename... Ts>
+    struct Results<std::tuple<Ts...>>
+    {
+        static const int count = sizeof...(Ts);
+        static bool get(lua_State* L, int first, std::tuple<Ts...>& results)
+        {
+            return getAll(L, first, results, typename binder::MakeIndices<sizeof...(Ts)>::type());
+        }
+
+        template <int... I>
+        static bool getAll(lua_State* L, int first, std::tuple<Ts...>& results, binder::Indices<I...>)
+        {
+            bool ok[] = { true, Result<Ts>::get(L, first + I, std::get<I>(results))... };
+            for(auto b : ok)
+            {
+                if(!b)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    template <typename... Args>
+    inline void pushArgs(lua_State* L, const Args&... args)
+    {
+        // expands to one push per argument, in order
+        int pushed[] = { 0, (binder::Value<typename binder::Arg<Args>::type>::push(L, args), 0)... };
+        (void) pushed;
+    }
+
+    /**
+     * Call the function on top of the stack, it is popped with the results.
+     */
+    template <typename R, typename... Args>
+    inline bool call(lua_State* L, R& results, const Args&... args)
+    {
+        pushArgs(L, args...);
+        if(lua_pcall(L, sizeof...(Args), Results<R>::count, 0) != LUA_OK)
+        {
+            std::cout << "[C++] call failed : " << lua_tostring(L, -1) << std::endl;
+            lua_pop(L, 1);
+            return false;
+        }
+        bool ok = Results<R>::get(L, lua_gettop(L) - Results<R>::count + 1, results);
+        lua_pop(L, Results<R>::count);
+        return ok;
+    }
+
+    /**
+     * Call the function of the handle.
+     */
+    template <typename R, typename... Args>
+    inline bool call(FunctionHandle& function, R& results, const Args&... args)
+    {
+        if(!function.push())
+        {
+            return false;
+        }
+        return call(function.state(), results, args...);
+    }
+}
+
+#endif
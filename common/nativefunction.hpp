@@ -0,0 +1,434 @@
+#ifndef COMMON_NATIVEFUNCTION_HPP
+#define COMMON_NATIVEFUNCTION_HPP
+#include <lua.hpp>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Evaluate simple lua formulas in C++ instead of calling them.
+ *
+ * compile reads the bytecode of a lua function (from lua_dump) and checks that it only does
+ * arithmetic on its parameters and number constants and returns one value, like
+ *     function snake_damage_func(x) return x + 2; end
+ *     function compute(x, y) return x - y end
+ * If it does, the expression is kept as a small postfix program that call runs on doubles,
+ * the same operations lua would do (lua numbers are doubles). Anything else (globals, tables,
+ * calls, branches, more than one result) is not compiled and has to be called as usual.
+ *
+ * The arguments must be numbers: with strings or tables lua would convert them or use their
+ * metamethods, which call doesn't do.
+ *
+ * Only the lua 5.2 bytecode format is understood, on other versions compile always fails.
+ */
+class NativeFunction
+{
+public:
+    NativeFunction()
+        : parameters(0), depth(0)
+    {
+    }
+
+    /**
+     * Try to compile the lua function at index. Returns false (and isCompiled is false)
+     * if it is not a simple formula.
+     */
+    bool compile(lua_State* L, int index)
+    {
+        program.clear();
+        parameters = 0;
+        depth = 0;
+        if(lua_type(L, index) != LUA_TFUNCTION || lua_iscfunction(L, index))
+        {
+            return false;
+        }
+        lua_pushvalue(L, index);
+        std::string bytecode;
+#if LUA_VERSION_NUM >= 503
+        int status = lua_dump(L, writeString, &bytecode, 0);
+#else
+        int status = lua_dump(L, writeString, &bytecode);
+#endif
+        lua_pop(L, 1);
+        if(status != 0)
+        {
+            return false;
+        }
+        Reader reader(bytecode);
+        std::vector<Tree> trees;
+        int result;
+        if(!analyse(reader, trees, result))
+        {
+            return false;
+        }
+        flatten(trees, result, 0);
+        if(depth > MAX_DEPTH || program.size() > MAX_STEPS)
+        {
+            program.clear();
+            return false;
+        }
+        return true;
+    }
+
+    bool isCompiled() const
+    {
+        return !program.empty();
+    }
+
+    // the number of arguments call takes
+    int arity() const
+    {
+        return parameters;
+    }
+
+    /**
+     * Run the formula, args must have arity() values.
+     */
+    lua_Number call(const lua_Number* args) const
+    {
+        lua_Number stack[MAX_DEPTH];
+        int top = 0;
+        for(auto& step : program)
+        {
+            switch(step.op)
+            {
+            case PARAM: stack[top++] = args[step.param]; break;
+            case CONSTANT: stack[top++] = step.value; break;
+            case UNM: stack[top - 1] = -stack[top - 1]; break;
+            default:
+                top--;
+                stack[top - 1] = arith(step.op, stack[top - 1], stack[top]);
+                break;
+            }
+        }
+        return stack[0];
+    }
+
+    lua_Number call(lua_Number x) const
+    {
+        return call(&x);
+    }
+
+    /**
+     * The formula, e.g. "(x1 + 2)", for printing.
+     */
+    std::string describe() const
+    {
+        std::vector<std::string> stack;
+        for(auto& step : program)
+        {
+            std::ostringstream out;
+            if(step.op == PARAM)
+            {
+                out << "x" << step.param + 1;
+            }
+            else if(step.op == CONSTANT)
+            {
+                out << step.value;
+            }
+            else if(step.op == UNM)
+            {
+                out << "-" << stack.back();
+                stack.pop_back();
+            }
+            else
+            {
+                std::string right = stack.back();
+                stack.pop_back();
+                out << "(" << stack.back() << " " << "+-*/%^"[step.op - ADD] << " " << right << ")";
+                stack.pop_back();
+            }
+            stack.push_back(out.str());
+        }
+        return stack.empty() ? "" : stack.back();
+    }
+
+private:
+    // the order matches the lua 5.2 opcodes OP_ADD to OP_UNM
+    enum Op
+    {
+        ADD,
+        SUB,
+        MUL,
+        DIV,
+        MOD,
+        POW,
+        UNM,
+        PARAM,
+        CONSTANT,
+    };
+
+    struct Step
+    {
+        Op op;
+        int param;
+        lua_Number value;
+    };
+
+    // a node of the expression while the bytecode is read
+    struct Tree
+    {
+        Op op;
+        int param;
+        lua_Number value;
+        int left;
+        int right;
+    };
+
+    static const int MAX_DEPTH = 32;
+    // a register used twice is copied into the program twice, so it can grow quickly.
+    static const size_t MAX_STEPS = 256;
+
+    std::vector<Step> program;
+    int parameters;
+    int depth;
+
+    static lua_Number arith(Op op, lua_Number a, lua_Number b)
+    {
+        switch(op)
+        {
+        case ADD: return a + b;
+        case SUB: return a - b;
+        case MUL: return a * b;
+        case DIV: return a / b;
+        // as luai_nummod and luai_numpow
+        case MOD: return a - std::floor(a / b) * b;
+        case POW: return std::pow(a, b);
+        default: return 0;
+        }
+    }
+
+    static int writeString(lua_State* L, const void* p, size_t size, void* data)
+    {
+        static_cast<std::string*>(data)->append(static_cast<const char*>(p), size);
+        return 0;
+    }
+
+    /**
+     * Reads the dump, every read fails once past the end.
+     */
+    struct Reader
+    {
+        Reader(const std::string& s)
+            : data(s), position(0), ok(true)
+        {
+        }
+        const std::string& data;
+        size_t position;
+        bool ok;
+
+        bool read(void* out, size_t size)
+        {
+            if(!ok || position + size > data.size())
+            {
+                ok = false;
+                return false;
+            }
+            memcpy(out, data.data() + position, size);
+            position += size;
+            return true;
+        }
+
+        int readByte()
+        {
+            unsigned char b = 0;
+            read(&b, 1);
+            return b;
+        }
+
+        int readInt()
+        {
+            int i = 0;
+            read(&i, sizeof(i));
+            return i;
+        }
+    };
+
+    /**
+     * Follow the code of the main function of the dump, keeping for each register the
+     * expression it holds. Stops at the first RETURN.
+     */
+    bool analyse(Reader& reader, std::vector<Tree>& trees, int& result)
+    {
+#if LUA_VERSION_NUM == 502
+        // header : signature, version, format, endianness, sizes of int, size_t, Instruction, lua_Number, integral
+        char header[18];
+        const int one = 1;
+        if(!reader.read(header, sizeof(header)) || memcmp(header, LUA_SIGNATURE, 4) != 0 || header[4] != 0x52
+            || header[6] != *reinterpret_cast<const char*>(&one) || header[7] != sizeof(int) || header[8] != sizeof(size_t) || header[9] != 4 || header[10] != sizeof(lua_Number) || header[11] != 0)
+        {
+            return false;
+        }
+        // linedefined, lastlinedefined
+        reader.readInt();
+        reader.readInt();
+        int numparams = reader.readByte();
+        int isVararg = reader.readByte();
+        reader.readByte();
+        if(!reader.ok || isVararg)
+        {
+            return false;
+        }
+        int codeSize = reader.readInt();
+        if(!reader.ok || codeSize < 0 || (size_t) codeSize * 4 > reader.data.size())
+        {
+            return false;
+        }
+        std::vector<unsigned> code(codeSize);
+        if(codeSize > 0 && !reader.read(code.data(), codeSize * 4))
+        {
+            return false;
+        }
+
+        // the constants, only numbers are of any use to us
+        int constantCount = reader.readInt();
+        if(!reader.ok || constantCount < 0)
+        {
+            return false;
+        }
+        std::vector<lua_Number> constants(constantCount);
+        std::vector<bool> isNumber(constantCount, false);
+        for(int i = 0; i < constantCount && reader.ok; i++)
+        {
+            int type = reader.readByte();
+            if(type == LUA_TNUMBER)
+            {
+                reader.read(&constants[i], sizeof(lua_Number));
+                isNumber[i] = true;
+            }
+            else if(type == LUA_TBOOLEAN)
+            {
+                reader.readByte();
+            }
+            else if(type == LUA_TSTRING)
+            {
+                size_t length = 0;
+                reader.read(&length, sizeof(length));
+                reader.position += length;
+            }
+            else if(type != LUA_TNIL)
+            {
+                return false;
+            }
+        }
+        // the rest (inner functions, upvalues, debug info) is not needed.
+        if(!reader.ok)
+        {
+            return false;
+        }
+
+        // registers 0 .. numparams - 1 are the parameters
+        std::vector<int> registers(256, -1);
+        for(int i = 0; i < numparams; i++)
+        {
+            Tree tree = { PARAM, i, 0, -1, -1 };
+            trees.push_back(tree);
+            registers[i] = i;
+        }
+        for(auto instruction : code)
+        {
+            int op = instruction & 0x3f;
+            int a = (instruction >> 6) & 0xff;
+            int c = (instruction >> 14) & 0x1ff;
+            int b = (instruction >> 23) & 0x1ff;
+            int bx = (instruction >> 14);
+            switch(op)
+            {
+            case 0: // MOVE A B : R(A) := R(B)
+                registers[a] = registers[b & 0xff];
+                break;
+            case 1: // LOADK A Bx : R(A) := Kst(Bx)
+            {
+                if(bx >= constantCount || !isNumber[bx])
+                {
+                    return false;
+                }
+                Tree tree = { CONSTANT, 0, constants[bx], -1, -1 };
+                trees.push_back(tree);
+                registers[a] = (int) trees.size() - 1;
+                break;
+            }
+            case 13: case 14: case 15: case 16: case 17: case 18: // ADD..POW A B C : R(A) := RK(B) op RK(C)
+            {
+                int left = operand(b, registers, trees, constants, isNumber);
+                int right = operand(c, registers, trees, constants, isNumber);
+                if(left < 0 || right < 0)
+                {
+                    return false;
+                }
+                Tree tree = { (Op) (ADD + op - 13), 0, 0, left, right };
+                trees.push_back(tree);
+                registers[a] = (int) trees.size() - 1;
+                break;
+            }
+            case 19: // UNM A B : R(A) := -R(B)
+            {
+                if(registers[b & 0xff] < 0)
+                {
+                    return false;
+                }
+                Tree tree = { UNM, 0, 0, registers[b & 0xff], -1 };
+                trees.push_back(tree);
+                registers[a] = (int) trees.size() - 1;
+                break;
+            }
+            case 31: // RETURN A B : return R(A), ... ,R(A+B-2)
+                if(b != 2 || registers[a] < 0)
+                {
+                    return false;
+                }
+                result = registers[a];
+                parameters = numparams;
+                return true;
+            default:
+                return false;
+            }
+        }
+        return false;
+#else
+        return false;
+#endif
+    }
+
+    // RK(x) : a constant if the top bit is set, a register otherwise
+    static int operand(int x, const std::vector<int>& registers, std::vector<Tree>& trees,
+                       const std::vector<lua_Number>& constants, const std::vector<bool>& isNumber)
+    {
+        if(x & 0x100)
+        {
+            int k = x & 0xff;
+            if(k >= (int) constants.size() || !isNumber[k])
+            {
+                return -1;
+            }
+            Tree tree = { CONSTANT, 0, constants[k], -1, -1 };
+            trees.push_back(tree);
+            return (int) trees.size() - 1;
+        }
+        return registers[x];
+    }
+
+    void flatten(const std::vector<Tree>& trees, int node, int height)
+    {
+        if(program.size() > MAX_STEPS)
+        {
+            return;
+        }
+        const Tree& tree = trees[node];
+        if(tree.left >= 0)
+        {
+            flatten(trees, tree.left, height);
+        }
+        if(tree.right >= 0)
+        {
+            flatten(trees, tree.right, height + 1);
+        }
+        Step step = { tree.op, tree.param, tree.value };
+        program.push_back(step);
+        depth = height + 1 > depth ? height + 1 : depth;
+    }
+};
+
+#endif
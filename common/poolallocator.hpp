@@ -0,0 +1,211 @@
+#ifndef COMMON_POOLALLOCATOR_HPP
+#define COMMON_POOLALLOCATOR_HPP
+#include <lua.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/**
+ * A lua_Alloc for a single lua_State.
+ *
+ * Small blocks (up to MAX_SMALL bytes) are rounded up to a multiple of GRANULARITY and kept in
+ * one free list per size. When a free list is empty, new blocks are bumped out of a large chunk,
+ * so most of the strings, tables and userdata that lua creates never reach malloc.
+ * Larger blocks go straight to realloc/free.
+ *
+ * Lua always tells us the old size of a block when freeing it, so the blocks don't need a header.
+ *
+ * Usage:
+ *     PoolAllocator allocator;
+ *     lua_State* L = allocator.newState();
+ *     ...
+ *     lua_close(L); // the allocator must outlive the state
+ */
+class PoolAllocator
+{
+public:
+    static const size_t GRANULARITY = 16;
+    static const size_t MAX_SMALL = 256;
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    struct Stats
+    {
+        Stats()
+            : bytesInUse(0), peakBytes(0), allocations(0), frees(0), reallocations(0), poolHits(0)
+        {
+        }
+        size_t bytesInUse;    // bytes currently held by lua
+        size_t peakBytes;     // highest bytesInUse seen
+        size_t allocations;   // new blocks
+        size_t frees;         // freed blocks
+        size_t reallocations; // blocks that changed size
+        size_t poolHits;      // small blocks served from a free list
+    };
+
+    PoolAllocator()
+        : bumpCurrent(0), bumpEnd(0)
+    {
+        for(size_t i = 0; i < CLASSES; i++)
+        {
+            freeLists[i] = 0;
+        }
+    }
+
+    ~PoolAllocator()
+    {
+        for(auto chunk : chunks)
+        {
+            free(chunk);
+        }
+    }
+
+    /**
+     * Create a new lua_State that allocates through this allocator.
+     */
+    lua_State* newState()
+    {
+        return lua_newstate(PoolAllocator::alloc, this);
+    }
+
+    const Stats& getStats() const
+    {
+        return stats;
+    }
+
+    /**
+     * Bytes reserved from the system for the small blocks.
+     */
+    size_t reservedBytes() const
+    {
+        return chunks.size() * CHUNK_SIZE;
+    }
+
+    /**
+     * The lua_Alloc function, ud is the PoolAllocator.
+     */
+    static void* alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+    {
+        PoolAllocator* self = static_cast<PoolAllocator*>(ud);
+        // when ptr is null, osize is the type of the object being created and not a size.
+        size_t oldSize = ptr ? osize : 0;
+        if(nsize == 0)
+        {
+            if(ptr)
+            {
+                self->release(ptr, oldSize);
+                self->stats.frees++;
+                self->stats.bytesInUse -= oldSize;
+            }
+            return 0;
+        }
+        void* block = 0;
+        if(!ptr)
+        {
+            block = self->acquire(nsize);
+            self->stats.allocations++;
+        }
+        else if(sizeClass(oldSize) == sizeClass(nsize) && nsize <= MAX_SMALL)
+        {
+            // still fits in the same block
+            block = ptr;
+            self->stats.reallocations++;
+        }
+        else if(oldSize > MAX_SMALL && nsize > MAX_SMALL)
+        {
+            block = realloc(ptr, nsize);
+            self->stats.reallocations++;
+        }
+        else
+        {
+            block = self->acquire(nsize);
+            if(block)
+            {
+                memcpy(block, ptr, oldSize < nsize ? oldSize : nsize);
+                self->release(ptr, oldSize);
+            }
+            self->stats.reallocations++;
+        }
+        if(block)
+        {
+            self->stats.bytesInUse += nsize;
+            self->stats.bytesInUse -= oldSize;
+            if(self->stats.bytesInUse > self->stats.peakBytes)
+            {
+                self->stats.peakBytes = self->stats.bytesInUse;
+            }
+        }
+        // returning null when nsize > 0 tells lua the allocation failed, and ptr is left untouched.
+        return block;
+    }
+
+private:
+    static const size_t CLASSES = MAX_SMALL / GRANULARITY;
+
+    // a free block stores the pointer to the next free block in itself.
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    FreeBlock* freeLists[CLASSES];
+    std::vector<char*> chunks;
+    char* bumpCurrent;
+    char* bumpEnd;
+    Stats stats;
+
+    static size_t sizeClass(size_t size)
+    {
+        return (size + GRANULARITY - 1) / GRANULARITY - 1;
+    }
+
+    void* acquire(size_t size)
+    {
+        if(size > MAX_SMALL)
+        {
+            return malloc(size);
+        }
+        size_t c = sizeClass(size);
+        if(freeLists[c])
+        {
+            FreeBlock* block = freeLists[c];
+            freeLists[c] = block->next;
+            stats.poolHits++;
+            return block;
+        }
+        size_t blockSize = (c + 1) * GRANULARITY;
+        if(bumpCurrent + blockSize > bumpEnd)
+        {
+            char* chunk = static_cast<char*>(malloc(CHUNK_SIZE));
+            if(!chunk)
+            {
+                return 0;
+            }
+            chunks.push_back(chunk);
+            // whatever is left of the old chunk is wasted, at most MAX_SMALL bytes.
+            bumpCurrent = chunk;
+            bumpEnd = chunk + CHUNK_SIZE;
+        }
+        void* block = bumpCurrent;
+        bumpCurrent += blockSize;
+        return block;
+    }
+
+    void release(void* ptr, size_t size)
+    {
+        if(size > MAX_SMALL)
+        {
+            free(ptr);
+            return;
+        }
+        size_t c = sizeClass(size);
+        FreeBlock* block = static_cast<FreeBlock*>(ptr);
+        block->next = freeLists[c];
+        freeLists[c] = block;
+    }
+
+    // the state points to this object
+    PoolAllocator(const PoolAllocator&);
+    PoolAllocator& operator=(const PoolAllocator&);
+};
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef COMMON_PROFILER_HPP
+#define COMMON_PROFILER_HPP
+#include <lua.hpp>
+#include <cstdio>
+#include <map>
+#include <string>
+
+/**
+ * A sampling profiler for the scripts running in a lua_State, built on lua_sethook.
+ *
+ * Every `period` VM instructions the count hook takes a sample: it walks the lua stack and
+ * counts the stack as "outer;...;inner" with each frame written as function@file:line.
+ * The counts are written in the folded format used by flamegraph.pl.
+ *
+ * Count hooks only fire while lua code runs, so time spent inside C functions is not seen by them.
+ * With sampleCalls, the call hook also samples one in `period` calls to C functions, which
+ * attributes them by the name given with nameCFunction (e.g. function_unit_dealtDamage).
+ * The call hook runs on every call, so that mode costs more than the count hook alone.
+ */
+class Profiler
+{
+public:
+    Profiler()
+        : L(0), period(1000), callCountdown(0), samples(0)
+    {
+    }
+
+    ~Profiler()
+    {
+        stop();
+    }
+
+    /**
+     * Give a name to a C function, used instead of the name lua knows it by.
+     */
+    void nameCFunction(lua_CFunction function, const std::string& name)
+    {
+        cNames[function] = name;
+    }
+
+    /**
+     * Start sampling the state, one sample every `period` instructions (and calls to C functions if sampleCalls).
+     */
+    void start(lua_State* state, int samplePeriod = 1000, bool sampleCalls = false)
+    {
+        stop();
+        L = state;
+        period = samplePeriod > 0 ? samplePeriod : 1;
+        callCountdown = period;
+        // the hook only gets the lua_State, so it finds the profiler in the registry.
+        lua_pushlightuserdata(L, this);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, registryKey());
+        lua_sethook(L, hook, LUA_MASKCOUNT | (sampleCalls ? LUA_MASKCALL : 0), period);
+    }
+
+    void stop()
+    {
+        if(!L)
+        {
+            return;
+        }
+        lua_sethook(L, 0, 0, 0);
+        lua_pushnil(L);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, registryKey());
+        L = 0;
+    }
+
+    void clear()
+    {
+        stacks.clear();
+        samples = 0;
+    }
+
+    long long sampleCount() const
+    {
+        return samples;
+    }
+
+    /**
+     * Write the folded stacks, one "stack count" per line.
+     */
+    bool writeFolded(const std::string& filename) const
+    {
+        FILE* file = fopen(filename.c_str(), "w");
+        if(!file)
+        {
+            return false;
+        }
+        for(auto& it : stacks)
+        {
+            fprintf(file, "%s %lld\n", it.first.c_str(), it.second);
+        }
+        fclose(file);
+        return true;
+    }
+
+private:
+    // the address of this is the key of the profiler in the registry.
+    static const void* registryKey()
+    {
+        static const char key = 0;
+        return &key;
+    }
+
+    lua_State* L;
+    int period;
+    int callCountdown;
+    long long samples;
+    std::map<lua_CFunction, std::string> cNames;
+    std::map<std::string, long long> stacks;
+
+    static void hook(lua_State* L, lua_Debug* ar)
+    {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, registryKey());
+        Profiler* self = static_cast<Profiler*>(lua_touserdata(L, -1));
+        lua_pop(L, 1);
+        if(!self)
+        {
+            return;
+        }
+        if(ar->event == LUA_HOOKCALL)
+        {
+            if(--self->callCountdown > 0)
+            {
+                return;
+            }
+            // only the calls to C functions, lua functions are seen by the count hook.
+            lua_getinfo(L, "S", ar);
+            if(ar->what[0] != 'C')
+            {
+                self->callCountdown = 1;
+                return;
+            }
+            self->callCountdown = self->period;
+        }
+        self->sample(L);
+    }
+
+    std::string frameName(lua_State* L, lua_Debug& frame)
+    {
+        // "f" pushes the function itself, to find the name of C functions
+        lua_getinfo(L, "Slnf", &frame);
+        std::string name;
+        if(frame.what[0] == 'C')
+        {
+            auto it = cNames.find(lua_tocfunction(L, -1));
+            name = it != cNames.end() ? it->second : std::string("[C] ") + (frame.name ? frame.name : "?");
+        }
+        else if(frame.what[0] == 'm')
+        {
+            name = std::string("main@") + frame.short_src;
+        }
+        else
+        {
+            char line[16];
+            snprintf(line, sizeof(line), ":%d", frame.currentline);
+            name = std::string(frame.name ? frame.name : "?") + "@" + frame.short_src + line;
+        }
+        lua_pop(L, 1);
+        return name;
+    }
+
+    void sample(lua_State* L)
+    {
+        std::string stack;
+        lua_Debug frame;
+        // level 0 is the running function, so build the stack from the innermost frame outwards.
+        for(int level = 0; lua_getstack(L, level, &frame); level++)
+        {
+            std::string name = frameName(L, frame);
+            stack = stack.empty() ? name : name + ";" + stack;
+        }
+        stacks[stack]++;
+        samples++;
+    }
+};
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef COMMON_PROPERTIES_HPP
+#define COMMON_PROPERTIES_HPP
+#include <lua.hpp>
+#include <vector>
+#include "binder.hpp"
+
+/**
+ * Expose data members as fields, so lua can write unit.health = 3 and local d = unit.damage
+ * instead of needing a getter/setter wrapper for each of them.
+ *
+ * When the properties are installed, a table from field name to field number is built once.
+ * Lua strings are interned, so finding the field is one hash lookup in that table, and the
+ * access itself is a load or store through the member pointer. Anything that is not a field
+ * (the methods) is looked up in the metatable as before. A field hides a method of the same name,
+ * so don't add a field named like one of the methods.
+ *
+ * The object is fetched with binder::Self<C>, and the Properties object must outlive the lua_State.
+ */
+template <typename C>
+class Properties
+{
+public:
+    void add(const char* name, int C::* member, bool readonly = false)
+    {
+        Field field = { name, INT, member, 0, readonly };
+        fields.push_back(field);
+    }
+
+    void add(const char* name, double C::* member, bool readonly = false)
+    {
+        Field field = { name, DOUBLE, 0, member, readonly };
+        fields.push_back(field);
+    }
+
+    /**
+     * Set __index and __newindex of the metatable on top of the stack.
+     * Call this after the methods are added to the metatable.
+     */
+    void install(lua_State* L)
+    {
+        int metatable = lua_gettop(L);
+        // name -> field number
+        lua_createtable(L, 0, (int) fields.size());
+        for(size_t i = 0; i < fields.size(); i++)
+        {
+            lua_pushinteger(L, (lua_Integer) i);
+            lua_setfield(L, -2, fields[i].name);
+        }
+        int lookup = lua_gettop(L);
+
+        lua_pushlightuserdata(L, this);
+        lua_pushvalue(L, lookup);
+        lua_pushvalue(L, metatable);
+        lua_pushcclosure(L, index, 3);
+        lua_setfield(L, metatable, "__index");
+
+        lua_pushlightuserdata(L, this);
+        lua_pushvalue(L, lookup);
+        lua_pushcclosure(L, newindex, 2);
+        lua_setfield(L, metatable, "__newindex");
+
+        lua_pop(L, 1);
+    }
+
+private:
+    enum Kind
+    {
+        INT,
+        DOUBLE,
+    };
+
+    struct Field
+    {
+        const char* name;
+        Kind kind;
+        int C::* intMember;
+        double C::* doubleMember;
+        bool readonly;
+    };
+
+    std::vector<Field> fields;
+
+    /**
+     * The field for the key at index 2, or null if it is not a field.
+     */
+    static const Field* findField(lua_State* L)
+    {
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(2));
+        if(lua_type(L, -1) != LUA_TNUMBER)
+        {
+            lua_pop(L, 1);
+            return 0;
+        }
+        const Properties* self = static_cast<const Properties*>(lua_touserdata(L, lua_upvalueindex(1)));
+        const Field* field = &self->fields[(size_t) lua_tointeger(L, -1)];
+        lua_pop(L, 1);
+        return field;
+    }
+
+    // __index(object, key), upvalues : properties, field lookup table, metatable.
+    static int index(lua_State* L)
+    {
+        const Field* field = findField(L);
+        if(!field)
+        {
+            // not a field, it may be a method.
+            lua_pushvalue(L, 2);
+            lua_rawget(L, lua_upvalueindex(3));
+            return 1;
+        }
+        C* object = binder::Self<C>::get(L, 1);
+        if(field->kind == INT)
+        {
+            lua_pushinteger(L, object->*(field->intMember));
+        }
+        else
+        {
+            lua_pushnumber(L, object->*(field->doubleMember));
+        }
+        return 1;
+    }
+
+    // __newindex(object, key, value), upvalues : properties, field lookup table.
+    static int newindex(lua_State* L)
+    {
+        const Field* field = findField(L);
+        if(!field || field->readonly)
+        {
+            return luaL_error(L, "cannot set field '%s'", lua_tostring(L, 2));
+        }
+        C* object = binder::Self<C>::get(L, 1);
+        if(field->kind == INT)
+        {
+            object->*(field->intMember) = (int) luaL_checkinteger(L, 3);
+        }
+        else
+        {
+            object->*(field->doubleMember) = luaL_checknumber(L, 3);
+        }
+        return 0;
+    }
+};
+
+#endif
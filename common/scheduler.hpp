@@ -0,0 +1,342 @@
+#ifndef COMMON_SCHEDULER_HPP
+#define COMMON_SCHEDULER_HPP
+#include <lua.hpp>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Run lua functions as coroutines, so a script can wait without blocking C++.
+ *
+ * spawn starts a function in a coroutine (a lua_newthread), and the script can then call
+ *     scheduler.wait(n)        -- continue n ticks later
+ *     scheduler.waitEvent(e)   -- continue after signal(e)
+ *     scheduler.spawn(f, ...)  -- start another task
+ * Every tick() resumes the tasks that are ready. Sleeping tasks are kept in a heap sorted by
+ * the tick they wake at, so a tick only looks at the ones that are due.
+ *
+ * The coroutine threads are kept in the registry and reused once their task ends, so starting
+ * a task does not allocate a new thread. A thread whose task raised an error is dead and is let go.
+ *
+ * Each wait gives the task a new ticket, and only the latest ticket of a live task resumes it,
+ * so a wait whose yield failed, or a task that ended, leaves nothing behind in the queues.
+ * A plain coroutine.yield() in a task is taken as wait(0).
+ *
+ * The Scheduler must outlive the tasks, and everything is run on the thread that owns the lua_State.
+ */
+class Scheduler
+{
+public:
+    Scheduler(lua_State* state)
+        : L(state), now(0), threadsCreated(0)
+    {
+        // the functions lua uses, with the scheduler as upvalue
+        lua_newtable(L);
+        const luaL_Reg functions[] = {
+            { "wait", function_wait },
+            { "waitEvent", function_waitEvent },
+            { "spawn", function_spawn },
+            { 0, 0 }
+        };
+        lua_pushlightuserdata(L, this);
+        luaL_setfuncs(L, functions, 1);
+        lua_setglobal(L, "scheduler");
+    }
+
+    ~Scheduler()
+    {
+        for(auto& task : tasks)
+        {
+            if(task.thread)
+            {
+                luaL_unref(L, LUA_REGISTRYINDEX, task.ref);
+            }
+        }
+        for(auto& thread : pool)
+        {
+            luaL_unref(L, LUA_REGISTRYINDEX, thread.ref);
+        }
+    }
+
+    /**
+     * Start a task. The function and its nargs arguments are popped from the stack,
+     * and the function runs up to its first wait at the next tick.
+     */
+    void spawn(int nargs)
+    {
+        spawn(L, nargs);
+    }
+
+    /**
+     * Wake the tasks waiting for the event, they run at the next tick.
+     */
+    void signal(const std::string& event)
+    {
+        auto it = events.find(event);
+        if(it == events.end())
+        {
+            return;
+        }
+        for(auto& ticket : it->second)
+        {
+            ready.push_back(ticket);
+        }
+        events.erase(it);
+    }
+
+    /**
+     * Move time forward by one tick, and resume the tasks that are ready.
+     * Returns the number of tasks resumed.
+     */
+    int tick()
+    {
+        now++;
+        while(!sleeping.empty() && sleeping.top().wakeTick <= now)
+        {
+            ready.push_back(sleeping.top().ticket);
+            sleeping.pop();
+        }
+        // tasks made ready while these run (spawned or signalled) wait for the next tick.
+        running.swap(ready);
+        int resumed = 0;
+        for(auto& ticket : running)
+        {
+            resumed += resume(ticket) ? 1 : 0;
+        }
+        running.clear();
+        return resumed;
+    }
+
+    unsigned long long currentTick() const
+    {
+        return now;
+    }
+
+    int taskCount() const
+    {
+        return (int) (tasks.size() - freeTasks.size());
+    }
+
+    // coroutine threads made so far, including the ones in the pool.
+    int threadCount() const
+    {
+        return threadsCreated;
+    }
+
+private:
+    struct Thread
+    {
+        lua_State* L;
+        int ref;
+    };
+
+    struct Task
+    {
+        lua_State* thread;
+        int ref;
+        int nargs;
+        // bumped by every wait and when the task ends, tickets with an older one are stale.
+        unsigned generation;
+        bool waiting;
+    };
+
+    // what the queues hold : a task and the wait it is for
+    struct Ticket
+    {
+        int task;
+        unsigned generation;
+    };
+
+    struct Sleeper
+    {
+        unsigned long long wakeTick;
+        Ticket ticket;
+        bool operator<(const Sleeper& other) const
+        {
+            // the earliest at the top of the heap
+            return wakeTick > other.wakeTick;
+        }
+    };
+
+    lua_State* L;
+    unsigned long long now;
+    int threadsCreated;
+    std::vector<Task> tasks;
+    std::vector<int> freeTasks;
+    std::vector<Thread> pool;
+    std::unordered_map<lua_State*, int> taskOfThread;
+    std::vector<Ticket> ready;
+    std::vector<Ticket> running;
+    std::priority_queue<Sleeper> sleeping;
+    std::map<std::string, std::vector<Ticket>> events;
+
+    Thread takeThread()
+    {
+        if(!pool.empty())
+        {
+            Thread thread = pool.back();
+            pool.pop_back();
+            return thread;
+        }
+        Thread thread;
+        thread.L = lua_newthread(L);
+        // the registry keeps the thread alive while it is used or pooled
+        thread.ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        threadsCreated++;
+        return thread;
+    }
+
+    // the function and arguments are on the stack of from, which may be a task spawning another one.
+    void spawn(lua_State* from, int nargs)
+    {
+        Thread thread = takeThread();
+        lua_xmove(from, thread.L, nargs + 1);
+
+        int id;
+        if(!freeTasks.empty())
+        {
+            id = freeTasks.back();
+            freeTasks.pop_back();
+        }
+        else
+        {
+            id = (int) tasks.size();
+            tasks.push_back(Task());
+            tasks[id].generation = 0;
+        }
+        tasks[id].thread = thread.L;
+        tasks[id].ref = thread.ref;
+        tasks[id].nargs = nargs;
+        taskOfThread[thread.L] = id;
+        ready.push_back(wait(id));
+    }
+
+    /**
+     * A new ticket for the task, the ones it had before no longer resume it.
+     */
+    Ticket wait(int id)
+    {
+        tasks[id].generation++;
+        tasks[id].waiting = true;
+        Ticket ticket = { id, tasks[id].generation };
+        return ticket;
+    }
+
+    /**
+     * Returns false if the ticket was stale and nothing was resumed.
+     */
+    bool resume(const Ticket& ticket)
+    {
+        int id = ticket.task;
+        if(!tasks[id].thread || !tasks[id].waiting || tasks[id].generation != ticket.generation)
+        {
+            return false;
+        }
+        tasks[id].waiting = false;
+        // copied, tasks may grow while the task runs and spawns others.
+        Thread thread = { tasks[id].thread, tasks[id].ref };
+        int nargs = tasks[id].nargs;
+        tasks[id].nargs = 0;
+#if LUA_VERSION_NUM >= 504
+        int nresults = 0;
+        int status = lua_resume(thread.L, L, nargs, &nresults);
+#else
+        int status = lua_resume(thread.L, L, nargs);
+#endif
+        if(status == LUA_YIELD)
+        {
+            lua_settop(thread.L, 0);
+            // the wait functions have already put it where it waits, a plain yield has not.
+            if(!tasks[id].waiting)
+            {
+                ready.push_back(wait(id));
+            }
+            return true;
+        }
+
+        taskOfThread.erase(thread.L);
+        tasks[id].thread = 0;
+        tasks[id].generation++;
+        tasks[id].waiting = false;
+        freeTasks.push_back(id);
+        if(status == LUA_OK)
+        {
+            lua_settop(thread.L, 0);
+            pool.push_back(thread);
+        }
+        else
+        {
+            std::cout << "[C++] task failed : " << lua_tostring(thread.L, -1) << std::endl;
+            luaL_unref(L, LUA_REGISTRYINDEX, thread.ref);
+        }
+        return true;
+    }
+
+    /**
+     * The scheduler and the task of the coroutine calling one of the lua functions.
+     */
+    static Scheduler* self(lua_State* L)
+    {
+        return static_cast<Scheduler*>(lua_touserdata(L, lua_upvalueindex(1)));
+    }
+
+    static int currentTask(lua_State* L)
+    {
+        Scheduler* scheduler = self(L);
+        auto it = scheduler->taskOfThread.find(L);
+        if(it == scheduler->taskOfThread.end())
+        {
+            return luaL_error(L, "can only wait inside a task");
+        }
+#if LUA_VERSION_NUM >= 503
+        // checked before the task is queued, the yield would fail in a callback like table.sort's
+        if(!lua_isyieldable(L))
+        {
+            return luaL_error(L, "cannot wait inside a C call");
+        }
+#endif
+        return it->second;
+    }
+
+    // scheduler.wait(ticks)
+    static int function_wait(lua_State* L)
+    {
+        int ticks = luaL_checkint(L, 1);
+        Scheduler* scheduler = self(L);
+        int id = currentTask(L);
+        // ticks <= 0 continues at the next tick
+        if(ticks <= 0)
+        {
+            scheduler->ready.push_back(scheduler->wait(id));
+        }
+        else
+        {
+            Sleeper sleeper = { scheduler->now + ticks, scheduler->wait(id) };
+            scheduler->sleeping.push(sleeper);
+        }
+        return lua_yield(L, 0);
+    }
+
+    // scheduler.waitEvent(event)
+    static int function_waitEvent(lua_State* L)
+    {
+        const char* event = luaL_checkstring(L, 1);
+        Scheduler* scheduler = self(L);
+        int id = currentTask(L);
+        scheduler->events[event].push_back(scheduler->wait(id));
+        return lua_yield(L, 0);
+    }
+
+    // scheduler.spawn(function, ...)
+    static int function_spawn(lua_State* L)
+    {
+        luaL_checktype(L, 1, LUA_TFUNCTION);
+        self(L)->spawn(L, lua_gettop(L) - 1);
+        return 0;
+    }
+};
+
+#endif
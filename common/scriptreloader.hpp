@@ -0,0 +1,309 @@
+#ifndef COMMON_SCRIPTRELOADER_HPP
+#define COMMON_SCRIPTRELOADER_HPP
+#include <lua.hpp>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "callbudget.hpp"
+#include "functionhandle.hpp"
+
+/**
+ * Reload scripts into a running lua_State when they change on disk (Linux only, uses inotify).
+ *
+ * A background thread waits for the files to be written, then compiles them in a scratch state
+ * and keeps the bytecode. Nothing touches the running state until update() is called,
+ * which should be done between ticks on the thread that owns the state: it runs the new chunks,
+ * which redefine the global functions, and marks the FunctionHandles as stale so that
+ * DamageFunction/ApplyDamageFunction pick up the new functions on their next call.
+ *
+ * A chunk runs with a table of its own as _ENV, which reads the real globals through __index,
+ * and the globals it set are only copied into _G once it has run to the end within the budget.
+ * A script that fails to compile, raises an error or runs out of budget is reported by update()
+ * and the old functions are all kept. (Only assignments to globals are held back like this:
+ * a chunk that changes a table it reached through a global changes the live one.)
+ */
+class ScriptReloader
+{
+public:
+    ScriptReloader(lua_State* state)
+        : budget(0, 1000), L(state), inotifyFd(-1), running(false)
+    {
+    }
+
+    // how long running a reloaded chunk may take, one second by default.
+    callbudget::Budget budget;
+
+    ~ScriptReloader()
+    {
+        stop();
+    }
+
+    /**
+     * Add a script to watch. Call this before start().
+     */
+    void watch(const std::string& filename)
+    {
+        std::string::size_type slash = filename.rfind('/');
+        std::string directory = slash == std::string::npos ? "." : filename.substr(0, slash);
+        std::string name = slash == std::string::npos ? filename : filename.substr(slash + 1);
+        watches.push_back(Watch(directory, name, filename));
+    }
+
+    /**
+     * Start the watcher thread. Returns false if inotify can't be used.
+     */
+    bool start()
+    {
+        if(running)
+        {
+            return true;
+        }
+        inotifyFd = inotify_init1(IN_NONBLOCK);
+        if(inotifyFd < 0)
+        {
+            return false;
+        }
+        for(auto& w : watches)
+        {
+            // watch the directory and not the file, editors often save by replacing the file.
+            w.wd = inotify_add_watch(inotifyFd, w.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        }
+        running = true;
+        watcher = std::thread(&ScriptReloader::watchLoop, this);
+        return true;
+    }
+
+    void stop()
+    {
+        if(!running)
+        {
+            return;
+        }
+        running = false;
+        watcher.join();
+        close(inotifyFd);
+        inotifyFd = -1;
+    }
+
+    /**
+     * Apply the scripts that were recompiled since the last call.
+     * Must be called from the thread that uses the lua_State, between ticks.
+     * Returns the number of scripts reloaded.
+     */
+    int update()
+    {
+        std::vector<Compiled> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(pending.empty())
+            {
+                return 0;
+            }
+            ready.swap(pending);
+        }
+        int reloaded = 0;
+        for(auto& compiled : ready)
+        {
+            if(!compiled.error.empty())
+            {
+                std::cout << "[C++] error reloading " << compiled.filename << " : " << compiled.error << std::endl;
+                continue;
+            }
+            Chunk chunk = { compiled.bytecode.data(), compiled.bytecode.size() };
+            std::string chunkname = "@" + compiled.filename;
+            if(lua_load(L, readChunk, &chunk, chunkname.c_str(), "b") != LUA_OK)
+            {
+                std::cout << "[C++] error reloading " << compiled.filename << " : " << lua_tostring(L, -1) << std::endl;
+                lua_pop(L, 1);
+                continue;
+            }
+            // the scratch _ENV, kept below the chunk to copy from afterwards
+            pushScratchEnvironment(L);
+            lua_insert(L, -2);
+            lua_pushvalue(L, -2);
+            // the only upvalue of a main chunk is its _ENV
+            lua_setupvalue(L, -2, 1);
+            if(callbudget::pcall(L, 0, 0, budget) != callbudget::OK)
+            {
+                std::cout << "[C++] error reloading " << compiled.filename << ", nothing changed : " << lua_tostring(L, -1) << std::endl;
+                lua_pop(L, 2);
+                continue;
+            }
+            commitEnvironment(L);
+            std::cout << "[C++] reloaded " << compiled.filename << std::endl;
+            reloaded++;
+        }
+        if(reloaded > 0)
+        {
+            FunctionHandle::reloaded(L);
+        }
+        return reloaded;
+    }
+
+private:
+    struct Watch
+    {
+        Watch(const std::string& d, const std::string& n, const std::string& f)
+            : directory(d), name(n), filename(f), wd(-1)
+        {
+        }
+        std::string directory;
+        std::string name;
+        std::string filename;
+        int wd;
+    };
+
+    struct Compiled
+    {
+        std::string filename;
+        std::vector<char> bytecode;
+        std::string error;
+    };
+
+    struct Chunk
+    {
+        const char* data;
+        size_t size;
+    };
+
+    lua_State* L;
+    std::vector<Watch> watches;
+    int inotifyFd;
+    std::atomic<bool> running;
+    std::thread watcher;
+    std::mutex mutex;
+    std::vector<Compiled> pending;
+
+    /**
+     * A new table whose missing keys are read from _G.
+     */
+    static void pushScratchEnvironment(lua_State* L)
+    {
+        lua_newtable(L);
+        lua_createtable(L, 0, 1);
+        lua_pushglobaltable(L);
+        lua_setfield(L, -2, "__index");
+        lua_setmetatable(L, -2);
+    }
+
+    /**
+     * Move the globals set in the scratch _ENV on top of the stack into _G, and pop it.
+     * The functions of the chunk keep it as their _ENV, so it is left empty with __index and
+     * __newindex to _G : from then on they read and write the real globals through it.
+     */
+    static void commitEnvironment(lua_State* L)
+    {
+        lua_pushglobaltable(L);
+        lua_pushnil(L);
+        while(lua_next(L, -3))
+        {
+            // env G key value -> rawset(G, key, value), keeping the key for lua_next
+            lua_pushvalue(L, -2);
+            lua_insert(L, -2);
+            lua_rawset(L, -4);
+            // clearing a field while traversing is allowed
+            lua_pushvalue(L, -1);
+            lua_pushnil(L);
+            lua_rawset(L, -5);
+        }
+        lua_getmetatable(L, -2);
+        lua_pushvalue(L, -2);
+        lua_setfield(L, -2, "__newindex");
+        lua_pop(L, 3);
+    }
+
+    static const char* readChunk(lua_State* L, void* ud, size_t* size)
+    {
+        Chunk* chunk = static_cast<Chunk*>(ud);
+        if(chunk->size == 0)
+        {
+            return 0;
+        }
+        *size = chunk->size;
+        chunk->size = 0;
+        return chunk->data;
+    }
+
+    static int writeChunk(lua_State* L, const void* p, size_t size, void* ud)
+    {
+        std::vector<char>* out = static_cast<std::vector<char>*>(ud);
+        out->insert(out->end(), static_cast<const char*>(p), static_cast<const char*>(p) + size);
+        return 0;
+    }
+
+    /**
+     * Compile the script in its own state, this never touches the running state.
+     */
+    static Compiled compile(const std::string& filename)
+    {
+        Compiled compiled;
+        compiled.filename = filename;
+        lua_State* compiler = luaL_newstate();
+        if(luaL_loadfile(compiler, filename.c_str()) != LUA_OK)
+        {
+            compiled.error = lua_tostring(compiler, -1);
+        }
+#if LUA_VERSION_NUM >= 503
+        else if(lua_dump(compiler, writeChunk, &compiled.bytecode, 0) != 0)
+#else
+        else if(lua_dump(compiler, writeChunk, &compiled.bytecode) != 0)
+#endif
+        {
+            compiled.error = "could not dump the chunk";
+        }
+        lua_close(compiler);
+        return compiled;
+    }
+
+    void watchLoop()
+    {
+        char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        while(running)
+        {
+            pollfd fd = { inotifyFd, POLLIN, 0 };
+            // wake up regularly to check if we have been stopped.
+            if(poll(&fd, 1, 100) <= 0)
+            {
+                continue;
+            }
+            ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+            if(length <= 0)
+            {
+                continue;
+            }
+            // a save can produce several events, only compile each file once.
+            std::map<std::string, bool> changed;
+            for(char* p = buffer; p < buffer + length; )
+            {
+                inotify_event* event = reinterpret_cast<inotify_event*>(p);
+                for(auto& w : watches)
+                {
+                    if(event->wd == w.wd && event->len > 0 && w.name == event->name)
+                    {
+                        changed[w.filename] = true;
+                    }
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+            for(auto& it : changed)
+            {
+                Compiled compiled = compile(it.first);
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.push_back(compiled);
+            }
+        }
+    }
+
+    // owns a thread and a file descriptor
+    ScriptReloader(const ScriptReloader&);
+    ScriptReloader& operator=(const ScriptReloader&);
+};
+
+#endif
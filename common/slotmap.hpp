@@ -0,0 +1,148 @@
+#ifndef COMMON_SLOTMAP_HPP
+#define COMMON_SLOTMAP_HPP
+#include <lua.hpp>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Objects referred to by handles instead of pointers, so lua can keep a reference to an object
+ * that has been removed since, and find out, instead of using a dangling pointer.
+ *
+ * A Handle is the index of a slot and the generation the slot had when the object was added.
+ * Removing the object bumps the generation of its slot, so the old handles no longer match.
+ * Getting an object is one compare of the generation and two array reads.
+ *
+ * The objects themselves are kept packed in one array (removing one moves the last one into
+ * its place), so iterating over the live objects with begin/end walks contiguous memory.
+ * Pointers to the objects are only valid until the next insert or remove, keep the Handle instead.
+ */
+template <typename T>
+class SlotMap
+{
+public:
+    struct Handle
+    {
+        uint32_t index;
+        uint32_t generation;
+    };
+
+    Handle insert(const T& object)
+    {
+        uint32_t index;
+        if(!freeSlots.empty())
+        {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            index = (uint32_t) slots.size();
+            Slot slot = { 0, 0 };
+            slots.push_back(slot);
+        }
+        slots[index].dense = (uint32_t) objects.size();
+        objects.push_back(object);
+        denseToSlot.push_back(index);
+        Handle handle = { index, slots[index].generation };
+        return handle;
+    }
+
+    /**
+     * Returns false if the handle was already stale.
+     */
+    bool remove(Handle handle)
+    {
+        if(!get(handle))
+        {
+            return false;
+        }
+        Slot& slot = slots[handle.index];
+        // move the last object into the hole
+        uint32_t last = (uint32_t) objects.size() - 1;
+        if(slot.dense != last)
+        {
+            objects[slot.dense] = objects[last];
+            denseToSlot[slot.dense] = denseToSlot[last];
+            slots[denseToSlot[last]].dense = slot.dense;
+        }
+        objects.pop_back();
+        denseToSlot.pop_back();
+        slot.generation++;
+        freeSlots.push_back(handle.index);
+        return true;
+    }
+
+    /**
+     * The object, or null if it has been removed.
+     */
+    T* get(Handle handle)
+    {
+        if(handle.index >= slots.size() || slots[handle.index].generation != handle.generation)
+        {
+            return 0;
+        }
+        return &objects[slots[handle.index].dense];
+    }
+
+    size_t size() const
+    {
+        return objects.size();
+    }
+
+    // the live objects, in memory order
+    typename std::vector<T>::iterator begin()
+    {
+        return objects.begin();
+    }
+
+    typename std::vector<T>::iterator end()
+    {
+        return objects.end();
+    }
+
+    /**
+     * Push a userdata holding the handle, with the metatable.
+     */
+    static void push(lua_State* L, Handle handle, const char* metatable)
+    {
+        Handle* userdata = static_cast<Handle*>(lua_newuserdata(L, sizeof(Handle)));
+        *userdata = handle;
+        luaL_setmetatable(L, metatable);
+    }
+
+    /**
+     * The object of the handle at index, or null if it has been removed
+     * or it is not a handle with that metatable (like luaL_testudata).
+     */
+    T* test(lua_State* L, int index, const char* metatable)
+    {
+        Handle* handle = static_cast<Handle*>(luaL_testudata(L, index, metatable));
+        return handle ? get(*handle) : 0;
+    }
+
+    /**
+     * Like test, but anything else than a live object is a lua error (like luaL_checkudata).
+     */
+    T* check(lua_State* L, int index, const char* metatable)
+    {
+        T* object = get(*static_cast<Handle*>(luaL_checkudata(L, index, metatable)));
+        luaL_argcheck(L, object != 0, index, "object has been removed");
+        return object;
+    }
+
+private:
+    struct Slot
+    {
+        // where the object is in objects
+        uint32_t dense;
+        uint32_t generation;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    std::vector<T> objects;
+    // the slot of each object, to fix the slot of the object moved by remove
+    std::vector<uint32_t> denseToSlot;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef COMMON_STATEPOOL_HPP
+#define COMMON_STATEPOOL_HPP
+#include <lua.hpp>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of independent lua_State, one for each worker thread.
+ *
+ * A lua_State can't be used by 2 threads at the same time, so instead of sharing one state
+ * every worker gets its own copy of the same scripts. The initializer is run on each state
+ * and should load the libraries, scripts and metatables.
+ */
+class StatePool
+{
+public:
+    typedef std::function<bool(lua_State*)> Initializer;
+
+    StatePool(size_t count, const Initializer& initializer)
+        : ready(true)
+    {
+        for(size_t i = 0; i < count; i++)
+        {
+            lua_State* L = luaL_newstate();
+            states.push_back(L);
+            if(!initializer(L))
+            {
+                ready = false;
+            }
+        }
+    }
+
+    ~StatePool()
+    {
+        for(auto L : states)
+        {
+            lua_close(L);
+        }
+    }
+
+    /**
+     * false if the initializer failed on any of the states.
+     */
+    bool isReady() const
+    {
+        return ready;
+    }
+
+    size_t size() const
+    {
+        return states.size();
+    }
+
+    lua_State* get(size_t index)
+    {
+        return states[index];
+    }
+
+    /**
+     * Split [0, count) into one contiguous range for each worker and run them in parallel.
+     * f is called as f(worker, L, begin, end) and must only touch the lua_State it is given.
+     * The calling thread runs the first range. workers is clamped to the size of the pool.
+     */
+    template <typename F>
+    void parallelFor(size_t count, size_t workers, F f)
+    {
+        if(workers > states.size())
+        {
+            workers = states.size();
+        }
+        if(workers == 0 || count == 0)
+        {
+            return;
+        }
+        size_t chunk = (count + workers - 1) / workers;
+        std::vector<std::thread> threads;
+        for(size_t w = 1; w < workers; w++)
+        {
+            size_t begin = w * chunk;
+            size_t end = begin + chunk < count ? begin + chunk : count;
+            if(begin >= end)
+            {
+                break;
+            }
+            lua_State* L = states[w];
+            threads.push_back(std::thread([=, &f]() { f(w, L, begin, end); }));
+        }
+        f(0, states[0], 0, chunk < count ? chunk : count);
+        for(auto& t : threads)
+        {
+            t.join();
+        }
+    }
+
+private:
+    std::vector<lua_State*> states;
+    bool ready;
+
+    // the states are owned by the pool
+    StatePool(const StatePool&);
+    StatePool& operator=(const StatePool&);
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef COMMON_TRACE_HPP
+#define COMMON_TRACE_HPP
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * Tracing for the hot paths, instead of std::cout << ... << std::endl in every wrapper.
+ *
+ * TRACE(level, event, arg) records a small binary record (time, thread, event id, argument)
+ * into a ring buffer owned by the calling thread, so there is no lock and no formatting.
+ * trace::dump writes the records to a file, and the decoder turns them back into text.
+ *
+ * The level is chosen at compile time with -DTRACE_LEVEL=n. Records above that level,
+ * and everything when TRACE_LEVEL is 0 (the default), compile to nothing.
+ */
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL 0
+#endif
+
+#define TRACE_ERROR 1
+#define TRACE_INFO 2
+#define TRACE_DEBUG 3
+
+#if TRACE_LEVEL > 0
+#define TRACE(level, event, arg) do { if((level) <= TRACE_LEVEL) { trace::record((event), (arg)); } } while(0)
+#else
+#define TRACE(level, event, arg) do { } while(0)
+#endif
+
+namespace trace
+{
+    static const uint32_t MAGIC = 0x45435254;
+    // records kept per thread, the oldest ones are overwritten.
+    static const size_t RING_SIZE = 1 << 16;
+
+    struct Record
+    {
+        uint64_t time;
+        uint32_t thread;
+        uint16_t event;
+        uint16_t arg;
+    };
+
+    struct Ring
+    {
+        Ring(uint32_t id)
+            : thread(id), head(0), records(RING_SIZE)
+        {
+        }
+        uint32_t thread;
+        std::atomic<uint64_t> head;
+        std::vector<Record> records;
+    };
+
+    /**
+     * All the rings, so that dump can find them. Only locked when a thread records for the first time.
+     */
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<Ring*> rings;
+    };
+
+    inline Registry& registry()
+    {
+        static Registry r;
+        return r;
+    }
+
+    inline Ring& threadRing()
+    {
+        // the rings are never freed, a dump can happen after the thread is gone.
+        static thread_local Ring* ring = 0;
+        if(!ring)
+        {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            ring = new Ring((uint32_t) r.rings.size());
+            r.rings.push_back(ring);
+        }
+        return *ring;
+    }
+
+    inline void record(uint16_t event, uint16_t arg)
+    {
+        Ring& ring = threadRing();
+        uint64_t head = ring.head.load(std::memory_order_relaxed);
+        Record& r = ring.records[head & (RING_SIZE - 1)];
+        r.time = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        r.thread = ring.thread;
+        r.event = event;
+        r.arg = arg;
+        // publish the record
+        ring.head.store(head + 1, std::memory_order_release);
+    }
+
+    /**
+     * Write the records of every thread, oldest first. Returns false if the file can't be written.
+     * Records written while the dump is running may be missing.
+     */
+    inline bool dump(const char* filename)
+    {
+        std::vector<Record> all;
+        {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            for(auto ring : r.rings)
+            {
+                uint64_t head = ring->head.load(std::memory_order_acquire);
+                uint64_t begin = head > RING_SIZE ? head - RING_SIZE : 0;
+                for(uint64_t i = begin; i < head; i++)
+                {
+                    all.push_back(ring->records[i & (RING_SIZE - 1)]);
+                }
+            }
+        }
+        std::stable_sort(all.begin(), all.end(), [](const Record& a, const Record& b) { return a.time < b.time; });
+
+        FILE* file = fopen(filename, "wb");
+        if(!file)
+        {
+            return false;
+        }
+        uint64_t count = all.size();
+        bool ok = fwrite(&MAGIC, sizeof(MAGIC), 1, file) == 1 && fwrite(&count, sizeof(count), 1, file) == 1
+            && (count == 0 || fwrite(all.data(), sizeof(Record), all.size(), file) == all.size());
+        fclose(file);
+        return ok;
+    }
+
+    /**
+     * Read a file written by dump.
+     */
+    inline bool load(const char* filename, std::vector<Record>& records)
+    {
+        FILE* file = fopen(filename, "rb");
+        if(!file)
+        {
+            return false;
+        }
+        uint32_t magic = 0;
+        uint64_t count = 0;
+        bool ok = fread(&magic, sizeof(magic), 1, file) == 1 && magic == MAGIC && fread(&count, sizeof(count), 1, file) == 1;
+        if(ok)
+        {
+            records.resize(count);
+            ok = count == 0 || fread(records.data(), sizeof(Record), count, file) == count;
+        }
+        fclose(file);
+        return ok;
+    }
+}
+
+#endif
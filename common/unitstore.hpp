@@ -0,0 +1,240 @@
+#ifndef COMMON_UNITSTORE_HPP
+#define COMMON_UNITSTORE_HPP
+#include <lua.hpp>
+#include <vector>
+#include "damagekernel.hpp"
+
+/**
+ * Units kept as columns, the damage of every unit in one array and the health in another,
+ * instead of one object per unit that lua reaches through its own userdata.
+ *
+ * Lua sees the whole store as one userdata:
+ *     units.health[i], units.damage[i]      -- read and write unit i (from 1, like lua arrays)
+ *     #units.health                         -- the number of units
+ *     units:dealtDamage(first, last, d)     -- unit first to last take d damage
+ *     units:dealtDamage(first, last, {...}) -- or the damage in the table for each of them
+ *     units:attack(first, last, target)     -- unit first+k hits unit target+k, for each k
+ * A loop over a column walks one contiguous array, and the bulk operations do the whole
+ * range in C++ without going back to lua for each unit, with the damagekernel.
+ *
+ * The store must outlive the userdata pushed with push.
+ */
+class UnitStore
+{
+public:
+    std::vector<int> damage;
+    std::vector<int> health;
+
+    /**
+     * Returns the index of the new unit, from 0.
+     */
+    int add(const int& d = 1, const int& h = 20)
+    {
+        damage.push_back(d);
+        health.push_back(h);
+        return (int) health.size() - 1;
+    }
+
+    int size() const
+    {
+        return (int) health.size();
+    }
+
+    /**
+     * Units [first, last) take amount damage, same as Unit::dealtDamage on each.
+     */
+    void dealtDamage(int first, int last, int amount)
+    {
+        damagekernel::dealtDamage(health.data() + first, last - first, amount);
+    }
+
+    /**
+     * Units [first, last) take amounts[0], amounts[1], ... damage.
+     */
+    void dealtDamage(int first, int last, const int* amounts)
+    {
+        damagekernel::dealtDamage(health.data() + first, last - first, amounts);
+    }
+
+    /**
+     * Unit first + k hits unit target + k with its damage, for first + k < last.
+     */
+    void attack(int first, int last, int target)
+    {
+        damagekernel::dealtDamage(health.data() + target, last - first, damage.data() + first);
+    }
+
+    /**
+     * Push the userdata lua uses for this store.
+     */
+    void push(lua_State* L)
+    {
+        loadMetatables(L);
+        UnitStore** userdata = static_cast<UnitStore**>(lua_newuserdata(L, sizeof(UnitStore*)));
+        *userdata = this;
+        luaL_setmetatable(L, "UnitStoreMT");
+
+        // the column userdata are made once and kept with the store, units.health makes nothing new.
+        lua_createtable(L, 0, 2);
+        pushColumn(L, DAMAGE);
+        lua_setfield(L, -2, "damage");
+        pushColumn(L, HEALTH);
+        lua_setfield(L, -2, "health");
+        lua_setuservalue(L, -2);
+    }
+
+private:
+    enum ColumnKind
+    {
+        DAMAGE,
+        HEALTH,
+    };
+
+    // the damage table of dealtDamage, kept so only the first big call allocates.
+    std::vector<int> amounts;
+
+    struct Column
+    {
+        UnitStore* store;
+        ColumnKind kind;
+
+        std::vector<int>& values()
+        {
+            return kind == DAMAGE ? store->damage : store->health;
+        }
+    };
+
+    void pushColumn(lua_State* L, ColumnKind kind)
+    {
+        Column* column = static_cast<Column*>(lua_newuserdata(L, sizeof(Column)));
+        column->store = this;
+        column->kind = kind;
+        luaL_setmetatable(L, "UnitColumnMT");
+    }
+
+    static UnitStore* checkStore(lua_State* L, int index)
+    {
+        return *static_cast<UnitStore**>(luaL_checkudata(L, index, "UnitStoreMT"));
+    }
+
+    /**
+     * The lua index at index as an index from 0, checked against the size.
+     */
+    static int checkIndex(lua_State* L, int index, int size)
+    {
+        int i = luaL_checkint(L, index);
+        luaL_argcheck(L, i >= 1 && i <= size, index, "unit index out of range");
+        return i - 1;
+    }
+
+    static void loadMetatables(lua_State* L)
+    {
+        if(luaL_newmetatable(L, "UnitStoreMT"))
+        {
+            const luaL_Reg methods[] = {
+                { "__index", function_store_index },
+                { "__len", function_store_len },
+                { "size", function_store_len },
+                { "dealtDamage", function_store_dealtDamage },
+                { "attack", function_store_attack },
+                { 0, 0 }
+            };
+            luaL_setfuncs(L, methods, 0);
+        }
+        lua_pop(L, 1);
+
+        if(luaL_newmetatable(L, "UnitColumnMT"))
+        {
+            const luaL_Reg methods[] = {
+                { "__index", function_column_index },
+                { "__newindex", function_column_newindex },
+                { "__len", function_column_len },
+                { 0, 0 }
+            };
+            luaL_setfuncs(L, methods, 0);
+        }
+        lua_pop(L, 1);
+    }
+
+    // units.health, units.damage, or a method.
+    static int function_store_index(lua_State* L)
+    {
+        checkStore(L, 1);
+        lua_getuservalue(L, 1);
+        lua_pushvalue(L, 2);
+        lua_rawget(L, -2);
+        if(lua_isnil(L, -1))
+        {
+            lua_pop(L, 2);
+            lua_getmetatable(L, 1);
+            lua_pushvalue(L, 2);
+            lua_rawget(L, -2);
+        }
+        return 1;
+    }
+
+    static int function_store_len(lua_State* L)
+    {
+        lua_pushinteger(L, checkStore(L, 1)->size());
+        return 1;
+    }
+
+    // units:dealtDamage(first, last, damage) or units:dealtDamage(first, last, {damage, ...})
+    static int function_store_dealtDamage(lua_State* L)
+    {
+        UnitStore* store = checkStore(L, 1);
+        int first = checkIndex(L, 2, store->size());
+        int last = checkIndex(L, 3, store->size());
+        if(!lua_istable(L, 4))
+        {
+            store->dealtDamage(first, last + 1, luaL_checkint(L, 4));
+            return 0;
+        }
+        int count = last + 1 - first;
+        luaL_argcheck(L, (int) lua_rawlen(L, 4) >= count, 4, "not enough damage values");
+        std::vector<int>& amounts = store->amounts;
+        amounts.resize(count > 0 ? count : 0);
+        for(int i = 0; i < count; i++)
+        {
+            lua_rawgeti(L, 4, i + 1);
+            amounts[i] = (int) lua_tointeger(L, -1);
+            lua_pop(L, 1);
+        }
+        store->dealtDamage(first, last + 1, amounts.data());
+        return 0;
+    }
+
+    // units:attack(first, last, target)
+    static int function_store_attack(lua_State* L)
+    {
+        UnitStore* store = checkStore(L, 1);
+        int first = checkIndex(L, 2, store->size());
+        int last = checkIndex(L, 3, store->size());
+        int target = checkIndex(L, 4, store->size());
+        luaL_argcheck(L, target + (last - first) < store->size(), 4, "target range out of range");
+        store->attack(first, last + 1, target);
+        return 0;
+    }
+
+    static int function_column_index(lua_State* L)
+    {
+        std::vector<int>& values = static_cast<Column*>(luaL_checkudata(L, 1, "UnitColumnMT"))->values();
+        lua_pushinteger(L, values[checkIndex(L, 2, (int) values.size())]);
+        return 1;
+    }
+
+    static int function_column_newindex(lua_State* L)
+    {
+        std::vector<int>& values = static_cast<Column*>(luaL_checkudata(L, 1, "UnitColumnMT"))->values();
+        values[checkIndex(L, 2, (int) values.size())] = luaL_checkint(L, 3);
+        return 0;
+    }
+
+    static int function_column_len(lua_State* L)
+    {
+        lua_pushinteger(L, static_cast<Column*>(luaL_checkudata(L, 1, "UnitColumnMT"))->values().size());
+        return 1;
+    }
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef COMMON_USERDATACACHE_HPP
+#define COMMON_USERDATACACHE_HPP
+#include <lua.hpp>
+
+/**
+ * Hand out the same userdata every time the same C++ object is passed to lua.
+ *
+ * Without this, putUnit/putCharacter create a new userdata on every call, which lua has to
+ * allocate and later collect. The cache is a table with weak values kept in the metatable,
+ * keyed by the address of the object, so once lua stops using a userdata it can still be collected.
+ *
+ * The userdata only holds a pointer, so when the C++ object dies, call invalidate: the pointer
+ * in the userdata is set to null (the wrappers check for it) and the entry is removed.
+ */
+namespace userdatacache
+{
+    // the address of this is used as the key of the cache table in the metatable.
+    // a local static of an inline function is the same in every translation unit.
+    inline const void* cacheKey()
+    {
+        static const char key = 0;
+        return &key;
+    }
+
+    /**
+     * Put the cache table of the metatable on the stack, creating it if needed.
+     */
+    inline void pushCache(lua_State* L, const char* metatable)
+    {
+        luaL_getmetatable(L, metatable);
+        lua_rawgetp(L, -1, cacheKey());
+        if(lua_isnil(L, -1))
+        {
+            lua_pop(L, 1);
+            lua_newtable(L);
+            // weak values, the cache alone doesn't keep a userdata alive.
+            lua_newtable(L);
+            lua_pushliteral(L, "v");
+            lua_setfield(L, -2, "__mode");
+            lua_setmetatable(L, -2);
+            lua_pushvalue(L, -1);
+            lua_rawsetp(L, -3, cacheKey());
+        }
+        // remove the metatable, leaving only the cache
+        lua_remove(L, -2);
+    }
+
+    /**
+     * Push the cached userdata of key and return true, or push nothing and return false.
+     */
+    inline bool pushCached(lua_State* L, const void* key, const char* metatable)
+    {
+        pushCache(L, metatable);
+        lua_rawgetp(L, -1, key);
+        if(lua_isnil(L, -1))
+        {
+            lua_pop(L, 2);
+            return false;
+        }
+        // remove the cache, leaving only the userdata
+        lua_remove(L, -2);
+        return true;
+    }
+
+    /**
+     * Remember the userdata on top of the stack as the one of key. The userdata stays on the stack.
+     */
+    inline void store(lua_State* L, const void* key, const char* metatable)
+    {
+        pushCache(L, metatable);
+        lua_pushvalue(L, -2);
+        lua_rawsetp(L, -2, key);
+        lua_pop(L, 1);
+    }
+
+    /**
+     * Push the userdata of object, with the given metatable.
+     */
+    template <typename T>
+    void push(lua_State* L, T* object, const char* metatable)
+    {
+        if(!pushCached(L, object, metatable))
+        {
+            T** userdata = static_cast<T**>(lua_newuserdata(L, sizeof(T*)));
+            *userdata = object;
+            luaL_setmetatable(L, metatable);
+            store(L, object, metatable);
+        }
+    }
+
+    /**
+     * The object is about to die, make sure lua can't reach it through the userdata anymore.
+     * The userdata must start with the pointer to the object.
+     */
+    inline void invalidate(lua_State* L, const void* object, const char* metatable)
+    {
+        pushCache(L, metatable);
+        lua_rawgetp(L, -1, object);
+        if(!lua_isnil(L, -1))
+        {
+            void** userdata = static_cast<void**>(lua_touserdata(L, -1));
+            *userdata = 0;
+            lua_pushnil(L);
+            lua_rawsetp(L, -3, object);
+        }
+        lua_pop(L, 2);
+    }
+}
+
+#endif
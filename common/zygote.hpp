@@ -0,0 +1,152 @@
+#ifndef COMMON_ZYGOTE_HPP
+#define COMMON_ZYGOTE_HPP
+#include <lua.hpp>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Start worker processes from a lua_State that is already set up.
+ *
+ * The initializer (libraries, scripts, metatables) runs once in the zygote. spawn then fork()s,
+ * and the child starts with the state ready to use, sharing the zygote's memory copy-on-write
+ * until it writes to it. Starting a worker costs a fork instead of loading everything again.
+ *
+ * Running the garbage collector writes to every object, which copies their pages into the child,
+ * so the zygote collects once before the first fork and the children can stop their collector
+ * (keepShared) if they don't allocate much.
+ *
+ * Linux/posix only. memoryOf reads /proc/<pid>/smaps_rollup.
+ */
+class Zygote
+{
+public:
+    typedef std::function<bool(lua_State*)> Initializer;
+    // runs in the child, the return value is the exit code of the worker.
+    typedef std::function<int(lua_State*)> Work;
+
+    Zygote(const Initializer& initializer)
+        : L(luaL_newstate()), ready(false)
+    {
+        ready = initializer(L);
+        // leave nothing to collect, the children would each copy the pages it is in.
+        lua_gc(L, LUA_GCCOLLECT, 0);
+    }
+
+    ~Zygote()
+    {
+        lua_close(L);
+    }
+
+    /**
+     * false if the initializer failed.
+     */
+    bool isReady() const
+    {
+        return ready;
+    }
+
+    lua_State* state()
+    {
+        return L;
+    }
+
+    /**
+     * Start a worker running work on its copy of the state. Returns the pid, or -1 if fork failed.
+     */
+    pid_t spawn(const Work& work, bool keepShared = false)
+    {
+        // anything still buffered would be written by the child too.
+        std::cout.flush();
+        fflush(stdout);
+        pid_t pid = fork();
+        if(pid != 0)
+        {
+            return pid;
+        }
+        if(keepShared)
+        {
+            lua_gc(L, LUA_GCSTOP, 0);
+        }
+        int code = work(L);
+        std::cout.flush();
+        fflush(stdout);
+        // no lua_close, it would only write to the pages we share.
+        _exit(code);
+    }
+
+    /**
+     * Wait for a worker to end. Returns its exit code, or -1.
+     */
+    static int wait(pid_t pid)
+    {
+        int status = 0;
+        if(waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+        {
+            return -1;
+        }
+        return WEXITSTATUS(status);
+    }
+
+    /**
+     * The memory of a process in kB. shared is what is mapped by other processes too,
+     * and pss counts each shared page divided by the number of processes using it.
+     */
+    struct Memory
+    {
+        long rss;
+        long pss;
+        long shared;
+        long privateMemory;
+    };
+
+    static bool memoryOf(pid_t pid, Memory& memory)
+    {
+        char filename[64];
+        snprintf(filename, sizeof(filename), "/proc/%d/smaps_rollup", (int) pid);
+        FILE* file = fopen(filename, "r");
+        if(!file)
+        {
+            return false;
+        }
+        memset(&memory, 0, sizeof(memory));
+        char line[256];
+        while(fgets(line, sizeof(line), file))
+        {
+            char key[64];
+            long kb;
+            if(sscanf(line, "%63[^:]: %ld kB", key, &kb) != 2)
+            {
+                continue;
+            }
+            if(!strcmp(key, "Rss"))
+            {
+                memory.rss = kb;
+            }
+            else if(!strcmp(key, "Pss"))
+            {
+                memory.pss = kb;
+            }
+            else if(!strcmp(key, "Shared_Clean") || !strcmp(key, "Shared_Dirty"))
+            {
+                memory.shared += kb;
+            }
+            else if(!strcmp(key, "Private_Clean") || !strcmp(key, "Private_Dirty"))
+            {
+                memory.privateMemory += kb;
+            }
+        }
+        fclose(file);
+        return true;
+    }
+
+private:
+    lua_State* L;
+    bool ready;
+};
+
+#endif
@@ -2,14 +2,15 @@
 #include <iostream>
 #include <sstream>
 #include <vector>
+#include "bytecodecache.hpp"
 
 /**
  * A Simple function to load and run the file. Instead of just using luaL_dofile, I have split them up to print the proper error message.
  */
 bool load(lua_State* L, const std::string& filename)
 {
-    // load the script
-    int status = luaL_loadfile(L, filename.c_str());
+    // load the script, the compiled chunk is cached in .luacache so it is only parsed once.
+    int status = bytecodecache::loadfile(L, filename);
     if(status != LUA_OK)
     {
         std::cout << "[C++] error loading script" << std::endl;
@@ -0,0 +1,16 @@
+-- used by "./run bench", the same read done through a method and through a field.
+function read_with_method(unit, n)
+    local total = 0;
+    for i = 1, n do
+        total = total + unit:getDamage();
+    end
+    return total;
+end
+
+function read_with_field(unit, n)
+    local total = 0;
+    for i = 1, n do
+        total = total + unit.damage;
+    end
+    return total;
+end
@@ -7,3 +7,10 @@ function applyDamage(attacker, target)
     target:dealtDamage(damage);
     print("[Lua] Damage dealt");
 end
+
+-- damage and health can also be used directly as fields
+function testproperties(unit)
+    print("[Lua] Damage " .. unit.damage .. " Health " .. unit.health);
+    unit.health = 3;
+    print("[Lua] After setting health " .. unit.health);
+end
@@ -1,7 +1,13 @@
 #include <lua.hpp>
+#include <chrono>
 #include <iostream>
 #include <sstream>
 #include <vector>
+#include "bytecodecache.hpp"
+#include "callbudget.hpp"
+#include "functionhandle.hpp"
+#include "properties.hpp"
+#include "userdatacache.hpp"
 
 ///////////// Unit Class ////////////
 class Unit 
@@ -29,32 +35,66 @@ public:
 void putUnit(lua_State* L, Unit& unit)
 {
     /**
-     * Create a userdata on the lua stack.
-     * This store the pointer to the unit object.
-     * The method returns a pointer to the pointer.
+     * Put the userdata of this unit on the lua stack.
+     * The userdata stores the pointer to the unit object and has the "UnitMT" metatable.
+     * The first time a unit is passed to lua a new userdata is created, after that the same one is reused
+     * instead of creating a new one on every call.
      */
-    Unit** userdata = static_cast<Unit**>(lua_newuserdata(L, sizeof(Unit*)));
-    /**
-     * Assign the pointer value to point to our unit object.
-     */
-    *userdata = &unit;
-    /**
-     * Set the metatable of that user data.
-     */
-    luaL_setmetatable(L, "UnitMT");
+    userdatacache::push(L, &unit, "UnitMT");
+}
+
+/**
+ * How the properties get the unit from the userdata.
+ */
+namespace binder
+{
+    template <>
+    struct Self<Unit>
+    {
+        static Unit* get(lua_State* L, int index)
+        {
+            Unit** unit = static_cast<Unit**>(luaL_checkudata(L, index, "UnitMT"));
+            luaL_argcheck(L, *unit != 0, index, "unit has been destroyed");
+            return *unit;
+        }
+    };
 }
 
+/**
+ * The fields of Unit that lua can read and write directly, e.g. unit.health = 3
+ * The health field replaces the health() method the unit had before : unit.health reads it
+ * and unit.health = 3 sets it.
+ * They are added once here, loadWrapper only installs them in each lua_State.
+ */
+Properties<Unit> makeUnitProperties()
+{
+    Properties<Unit> properties;
+    properties.add("damage", &Unit::damage);
+    properties.add("health", &Unit::health);
+    return properties;
+}
+Properties<Unit> unitProperties = makeUnitProperties();
+
 ////////////////////////////////
 ///////// Apply damage function wrapper //////////
 class ApplyDamageFunction
 {
 public:
-    ApplyDamageFunction(const std::string& functionname) 
-        : function(functionname)
+    ApplyDamageFunction(lua_State* L, const std::string& functionname) 
+        : function(L, functionname)
     {
     }
 
-    std::string function;
+    /**
+     * The lua function. It is looked up once and kept in the registry,
+     * so we don't have to do a lua_getglobal every time we call it.
+     */
+    FunctionHandle function;
+
+    /**
+     * How long a single call may run, no limit by default.
+     */
+    callbudget::Budget budget;
 
     /**
      * This method mirrors the function in the lua script.
@@ -62,21 +102,24 @@ public:
     void applyDamage(lua_State* L, Unit& attacker, Unit& defender)
     {
         // put the function on the stack
-        lua_getglobal(L, function.c_str());
-        int type = lua_type(L, -1);
-        if(type == LUA_TFUNCTION)
+        if(function.push())
         {
             // create a new user data on the stack, and assign the attacker pointer to it
             putUnit(L, attacker);
             // create a new user data on the stack, and assign the defender pointer to it
             putUnit(L, defender);
-            // call the function
-            lua_call(L, 2, 0);
+            // call the function, a script that errors or runs too long is stopped instead of taking us down.
+            callbudget::Status status = callbudget::pcall(L, 2, 0, budget);
+            if(status != callbudget::OK)
+            {
+                std::cout << "[C++] " << function.getName() << (status == callbudget::TIMEOUT ? " timed out : " : " failed : ") << lua_tostring(L, -1) << std::endl;
+                lua_pop(L, 1);
+            }
             // shouldn't have anything to pop
         }
         else
         {
-            std::cout << "Cannot find " << function << "function" << std::endl;
+            std::cout << "Cannot find " << function.getName() << "function" << std::endl;
         }
     }
 };
@@ -88,8 +131,8 @@ public:
  */
 bool load(lua_State* L, const std::string& filename)
 {
-    // load the script
-    int status = luaL_loadfile(L, filename.c_str());
+    // load the script, the compiled chunk is cached in .luacache so it is only parsed once.
+    int status = bytecodecache::loadfile(L, filename);
     if(status != LUA_OK)
     {
         std::cout << "[C++] error loading script" << std::endl;
@@ -104,6 +147,8 @@ bool load(lua_State* L, const std::string& filename)
         std::cout << "[C++] Could not run the script." << std::endl;
         return false;
     }
+    // the script may have redefined the functions, so the handles have to look them up again.
+    FunctionHandle::reloaded(L);
     return true;
 }
 
@@ -117,7 +162,7 @@ extern "C"
          * else it will return the pointer to the pointer.
          */
         Unit** unit = static_cast<Unit**>(luaL_testudata(L, 1, "UnitMT"));
-        if(unit)
+        if(unit && *unit)
         {
             int damage = (**unit).getDamage();
             lua_pushnumber(L, damage);
@@ -133,45 +178,12 @@ extern "C"
     {
         Unit** unit = static_cast<Unit**>(luaL_testudata(L, 1, "UnitMT"));
         int damage = luaL_checkint(L, 2);
-        if(unit)
+        if(unit && *unit)
         {
             (**unit).dealtDamage(damage);
         }
         return 0; 
     }
-
-    static int function_unit_health(lua_State* L)
-    {
-        int args = lua_gettop(L);
-        Unit** unit = static_cast<Unit**>(luaL_testudata(L, 1, "UnitMT"));
-        std::cout << "[C++]" << "calling method \"health\"" << std::endl;
-        if(args == 1) // if there are no argument other than self, we will just return the health value
-        {
-            if(unit)
-            {
-                lua_pushnumber(L, (**unit).health);
-            }
-            else
-            {
-                lua_pushnil(L);
-            }
-            return 1;
-        }
-        else // else, we will set the value to the first argument after "self"
-        {
-            int health = luaL_checkint(L, 2);
-            if(unit)
-            {
-                (**unit).health = health;
-                lua_pushnumber(L, health);
-            }
-            else
-            {
-                lua_pushnil(L);
-            }
-            return 1;
-        }
-    }
 }
 
 void loadWrapper(lua_State* L)
@@ -180,12 +192,6 @@ void loadWrapper(lua_State* L)
      * This creates the meta table and put it on the stack and give it a name so you can use it later.
      */
     luaL_newmetatable(L, "UnitMT");
-    /**
-     * __index is where Lua will search when it can't find the methods in the current table, kind of like the parent class
-     * So in this case, we will set the it to itself. 
-     */
-    lua_pushvalue(L, -1);
-    lua_setfield(L, -2, "__index");
     /**
      * Each of the follow pairs push the cfunction onto the stack and add the function to the metatable.
      * The metatable will still be on the stack after each of the call.
@@ -196,9 +202,12 @@ void loadWrapper(lua_State* L)
     // set the dealt damage method
     lua_pushcfunction(L, function_unit_dealtDamage);
     lua_setfield(L, -2, "dealtDamage");
-    // set the health method
-    lua_pushcfunction(L, function_unit_health);
-    lua_setfield(L, -2, "health");
+    /**
+     * __index is where Lua will search when it can't find the key in the userdata.
+     * Instead of setting it to the metatable itself, the properties set __index and __newindex to functions
+     * that read and write damage and health directly, and look up everything else (the methods) in the metatable.
+     */
+    unitProperties.install(L);
     // pop the meta table from the stack
     lua_pop(L, 1);
 }
@@ -210,7 +219,7 @@ void doThings(lua_State* L)
     // load the Unit Wrapper.
     loadWrapper(L);
 
-    ApplyDamageFunction damageFunction("applyDamage");
+    ApplyDamageFunction damageFunction(L, "applyDamage");
 
     Unit unit1(12, 30);
     Unit unit2(7, 40);
@@ -220,7 +229,43 @@ void doThings(lua_State* L)
     std::cout << "Health of unit1 and unit2 after unit1 deals damage to unit2 : [Unit1 : " << unit1.health << "] [Unit2 : " << unit2.health << "]" << std::endl;
     damageFunction.applyDamage(L, unit2, unit1);
     std::cout << "Health of unit1 and unit2 after unit2 deals damage to unit1 : [Unit1 : " << unit1.health << "] [Unit2 : " << unit2.health << "]" << std::endl;
-    
+
+    // read and write the fields from lua
+    lua_getglobal(L, "testproperties");
+    putUnit(L, unit1);
+    lua_call(L, 1, 0);
+    std::cout << "Health of unit1 after testproperties : [Unit1 : " << unit1.health << "]" << std::endl;
+
+    /**
+     * The units die at the end of this function, so clear the pointer in their userdata.
+     * The wrappers check for it, so lua can't use a dead unit.
+     */
+    userdatacache::invalidate(L, &unit1, "UnitMT");
+    userdatacache::invalidate(L, &unit2, "UnitMT");
+}
+
+/**
+ * Compare reading the damage through the getDamage method against reading the damage field.
+ */
+void benchmark(lua_State* L)
+{
+    load(L, "bench.lua");
+    loadWrapper(L);
+
+    Unit unit(12, 30);
+    const int iterations = 10000000;
+    const char* functions[] = { "read_with_method", "read_with_field" };
+    for(auto name : functions)
+    {
+        lua_getglobal(L, name);
+        putUnit(L, unit);
+        lua_pushinteger(L, iterations);
+        auto start = std::chrono::steady_clock::now();
+        lua_call(L, 2, 0);
+        auto end = std::chrono::steady_clock::now();
+        std::cout << name << " : " << (std::chrono::duration<double, std::nano>(end - start).count() / iterations) << " ns/access" << std::endl;
+    }
+    userdatacache::invalidate(L, &unit, "UnitMT");
 }
 
 int main(int argc, char* argv[])
@@ -240,7 +285,14 @@ int main(int argc, char* argv[])
         lua_settop(L, 0);
     }
 
-    doThings(L);
+    if(argc > 1 && std::string(argv[1]) == "bench")
+    {
+        benchmark(L);
+    }
+    else
+    {
+        doThings(L);
+    }
 
     lua_close(L);
     return 0;
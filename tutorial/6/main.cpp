@@ -2,14 +2,16 @@
 #include <iostream>
 #include <sstream>
 #include <vector>
+#include "bytecodecache.hpp"
+#include "luacall.hpp"
 
 /**
  * A Simple function to load and run the file. Instead of just using luaL_dofile, I have split them up to print the proper error message.
  */
 bool load(lua_State* L, const std::string& filename)
 {
-    // load the script
-    int status = luaL_loadfile(L, filename.c_str());
+    // load the script, the compiled chunk is cached in .luacache so it is only parsed once.
+    int status = bytecodecache::loadfile(L, filename);
     if(status != LUA_OK)
     {
         std::cout << "[C++] error loading script" << std::endl;
@@ -24,37 +26,16 @@ bool load(lua_State* L, const std::string& filename)
         std::cout << "[C++] Could not run the script." << std::endl;
         return false;
     }
+    // the script may have replaced the functions (or their tables), look them up again.
+    FunctionHandle::reloaded(L);
     return true;
 }
 
-// a multiple return.
-std::vector<int> multi(lua_State* L, int x, int y, int z)
+// a multiple return, read straight into the tuple. Returns false if the function is missing or fails.
+// the handle follows "functions.computation.multi_compute" once, and after each reload.
+bool multi(FunctionHandle& multiCompute, int x, int y, int z, std::tuple<int, int, int>& ints)
 {
-    std::vector<int> ints;
-    lua_getglobal(L, "functions");
-    lua_getfield(L, -1, "computation");
-    lua_remove(L, -2);
-    lua_getfield(L, -1, "multi_compute");
-    lua_remove(L, -2);
-    if(lua_type(L, -1) == LUA_TFUNCTION)
-    {   
-        lua_pushnumber(L, x);
-        lua_pushnumber(L, y);
-        lua_pushnumber(L, z);
-        lua_call(L, 3, 3);
-        int xy = (int) luaL_checkint(L, -3);
-        int yz = (int) luaL_checkint(L, -2);
-        int xz = (int) luaL_checkint(L, -1);
-        lua_pop(L, 3);
-        ints.push_back(xy);
-        ints.push_back(yz);
-        ints.push_back(xz);
-    }
-    else
-    {
-        lua_pop(L, 1);
-    }
-    return ints;
+    return luacall::call(multiCompute, ints, x, y, z);
 }
 
 void doThings(lua_State* L)
@@ -88,12 +69,22 @@ void doThings(lua_State* L)
     
     ////////////////////// multiple return value function -- "multi_compute" //////////////
 
-    auto ints = multi(L, 1, 3, 5);
-    if(ints.size() == 3)
+    FunctionHandle multiCompute(L, "functions.computation.multi_compute");
+    std::tuple<int, int, int> ints;
+    if(multi(multiCompute, 1, 3, 5, ints))
+    {
+        std::cout << "[C++] X + Y : " << std::get<0>(ints) << std::endl;
+        std::cout << "[C++] Y + Z : " << std::get<1>(ints) << std::endl;
+        std::cout << "[C++] X + Z : " << std::get<2>(ints) << std::endl;
+    }
+
+    // after a reload the handle finds the new function
+    load(L, "function.lua");
+    if(multi(multiCompute, 2, 4, 6, ints))
     {
-        std::cout << "[C++] X + Y : " << ints[0] << std::endl;
-        std::cout << "[C++] Y + Z : " << ints[1] << std::endl;
-        std::cout << "[C++] X + Z : " << ints[2] << std::endl;
+        std::cout << "[C++] X + Y : " << std::get<0>(ints) << std::endl;
+        std::cout << "[C++] Y + Z : " << std::get<1>(ints) << std::endl;
+        std::cout << "[C++] X + Z : " << std::get<2>(ints) << std::endl;
     }
 
 }